@@ -77,6 +77,10 @@
 #define STR_SIZE1 "Use arrows to size"
 #define STR_SIZE2 "ENTER to accept"
 #define STR_SIZE3 "ESC to cancel"
+#define STR_DETAIL "D to change detail: "
+#define STR_DETAILHIGH "high"
+#define STR_DETAILLOW "low"
+#define STR_DETAILLOWEST "lowest"
 
 #define STR_YOUWIN "you win!"
 
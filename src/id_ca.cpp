@@ -917,6 +917,8 @@ void CA_CacheGrChunk(int chunk)
     if (pos < 0) // $FFFFFFFF start is a sparse tile
         return;
 
+    TraceBegin("CA_CacheGrChunk");
+
     next = chunk + 1;
     while (GRFILEPOS(next) == -1) // skip past any sparse tiles
         next++;
@@ -941,6 +943,8 @@ void CA_CacheGrChunk(int chunk)
 
     if (compressed > BUFFERSIZE)
         free(source);
+
+    TraceEnd();
 }
 
 //==========================================================================
@@ -1029,6 +1033,8 @@ void CA_CacheMap(int mapnum)
     int32_t expanded;
 #endif
 
+    TraceBegin("CA_CacheMap");
+
     mapon = mapnum;
 
     //
@@ -1079,6 +1085,8 @@ void CA_CacheMap(int mapnum)
         if (compressed > BUFFERSIZE)
             free(bigbufferseg);
     }
+
+    TraceEnd();
 }
 
 //===========================================================================
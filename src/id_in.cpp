@@ -690,7 +690,7 @@ boolean IN_UserInput(longword delay)
         IN_ProcessEvents();
         if (IN_CheckAck())
             return true;
-        SDL_Delay(5);
+        TM_WaitNextTic();
     } while (GetTimeCount() - lasttime < delay);
     return (false);
 }
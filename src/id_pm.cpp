@@ -19,6 +19,8 @@ void PM_Startup()
     char fname[13] = "vswap.";
     strcat(fname, extension);
 
+    TraceBegin("PM_Startup");
+
     FILE *file = fopen(fname, "rb");
     if (!file)
         CA_CannotOpen(fname);
@@ -121,6 +123,8 @@ void PM_Startup()
     free(pageLengths);
     free(pageOffsets);
     fclose(file);
+
+    TraceEnd();
 }
 
 void PM_Shutdown()
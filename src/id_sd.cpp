@@ -543,6 +543,8 @@ void SD_PrepareSound(int which)
     if (origsamples + size >= PM_GetEnd())
         Quit("SD_PrepareSound(%i): Sound reaches out of page file!\n", which);
 
+    TraceBegin("SD_PrepareSound");
+
     int destsamples = (int)((float)size * (float)param_samplerate / (float)ORIGSAMPLERATE);
 
     byte *wavebuffer =
@@ -579,6 +581,8 @@ void SD_PrepareSound(int which)
 
     SoundChunks[which] =
         Mix_LoadWAV_RW(SDL_RWFromMem(wavebuffer, sizeof(headchunk) + sizeof(wavechunk) + destsamples * 2), 1);
+
+    TraceEnd();
 }
 
 int SD_PlayDigitized(word which, int leftpos, int rightpos)
@@ -934,7 +938,7 @@ boolean SD_SetMusicMode(SMMode mode)
 
     SD_FadeOutMusic();
     while (SD_MusicPlaying())
-        SDL_Delay(5);
+        TM_WaitNextTic();
 
     switch (mode)
     {
@@ -964,6 +968,8 @@ int samplesPerMusicTick;
 
 void SDL_IMFMusicPlayer(void *udata, Uint8 *stream, int len)
 {
+    TraceBegin("SDL_IMFMusicPlayer");
+
     SDL_memset(stream, 0, len);
 
     int stereolen = len >> 1;
@@ -984,7 +990,7 @@ void SDL_IMFMusicPlayer(void *udata, Uint8 *stream, int len)
             {
                 YM3812UpdateOne(0, stream16, sampleslen);
                 numreadysamples -= sampleslen;
-                return;
+                break;
             }
         }
         soundTimeCounter--;
@@ -1038,6 +1044,8 @@ void SDL_IMFMusicPlayer(void *udata, Uint8 *stream, int len)
         }
         numreadysamples = samplesPerMusicTick;
     }
+
+    TraceEnd();
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -1279,7 +1287,7 @@ void SD_StopSound(void)
 void SD_WaitSoundDone(void)
 {
     while (SD_SoundPlaying())
-        SDL_Delay(5);
+        TM_WaitNextTic();
 }
 
 ///////////////////////////////////////////////////////////////////////////
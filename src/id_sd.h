@@ -115,14 +115,6 @@ extern SMMode MusicMode;
 extern int DigiMap[];
 extern int DigiChannel[];
 
-#define GetTimeCount() ((SDL_GetTicks() * 7) / 100)
-
-inline void Delay(int wolfticks)
-{
-    if (wolfticks > 0)
-        SDL_Delay(wolfticks * 100 / 7);
-}
-
 // Function prototypes
 extern void SD_Startup(void), SD_Shutdown(void);
 
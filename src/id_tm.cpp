@@ -0,0 +1,180 @@
+//
+//  ID Engine
+//  ID_TM.c - Timer Manager
+//
+
+//
+//  This module keeps the 70 Hz tic clock on the high resolution
+//  performance counter, and waits for deadlines on it by sleeping for
+//  most of the time and spinning through the rest, as SDL_Delay only
+//  wakes up somewhere in the millisecond after the requested one
+//
+
+#include "wl_def.h"
+
+#define SLEEPMARGINMIN 1 // milliseconds always spun away before a deadline
+#define SLEEPMARGINMAX 4 // never spin longer than this
+
+Uint64 tmfreq;
+
+static Uint64 tmstart;
+static Uint64 sleepmargin; // how late SDL_Delay has been waking up recently
+
+/*
+===================
+=
+= TM_Startup
+=
+===================
+*/
+
+void TM_Startup(void)
+{
+    tmfreq = SDL_GetPerformanceFrequency();
+    tmstart = SDL_GetPerformanceCounter();
+    sleepmargin = tmfreq * SLEEPMARGINMIN / 1000;
+}
+
+/*
+===================
+=
+= TM_Now
+=
+===================
+*/
+
+Uint64 TM_Now(void)
+{
+    return SDL_GetPerformanceCounter() - tmstart;
+}
+
+/*
+===================
+=
+= TM_GetTimeCount
+=
+= Number of tics since TM_Startup
+=
+===================
+*/
+
+int32_t TM_GetTimeCount(void)
+{
+    return (int32_t)(TM_Now() * TICRATE / tmfreq);
+}
+
+/*
+===================
+=
+= TM_TicDeadline
+=
+= The time at which the given tic starts
+=
+===================
+*/
+
+Uint64 TM_TicDeadline(int32_t tic)
+{
+    if (tic <= 0)
+        return 0;
+
+    return ((Uint64)tic * tmfreq + TICRATE - 1) / TICRATE;
+}
+
+/*
+===================
+=
+= TM_TicFraction
+=
+= How far into the given tic the clock is, from 0 to GLOBAL1
+=
+===================
+*/
+
+fixed TM_TicFraction(int32_t tic)
+{
+    Uint64 start = TM_TicDeadline(tic);
+    Uint64 now = TM_Now();
+
+    if (now <= start)
+        return 0;
+
+    Uint64 elapsed = (now - start) * TICRATE;
+    if (elapsed >= tmfreq)
+        return GLOBAL1;
+
+    return (fixed)((elapsed << 16) / tmfreq);
+}
+
+/*
+===================
+=
+= TM_WaitUntil
+=
+= Sleeps until shortly before the deadline and spins through the rest
+=
+===================
+*/
+
+void TM_WaitUntil(Uint64 deadline)
+{
+    Uint64 now = TM_Now();
+
+    while (now + sleepmargin < deadline)
+    {
+        Uint32 ms = (Uint32)((deadline - now - sleepmargin) * 1000 / tmfreq);
+        if (!ms)
+            break;
+
+        Uint64 wake = now + ms * tmfreq / 1000;
+        SDL_Delay(ms);
+        now = TM_Now();
+
+        //
+        // keep the margin at the latest wake up seen, letting it shrink
+        // again slowly
+        //
+        if (now > wake && now - wake > sleepmargin)
+            sleepmargin = now - wake;
+        else
+            sleepmargin -= sleepmargin / 64;
+
+        if (sleepmargin < tmfreq * SLEEPMARGINMIN / 1000)
+            sleepmargin = tmfreq * SLEEPMARGINMIN / 1000;
+        else if (sleepmargin > tmfreq * SLEEPMARGINMAX / 1000)
+            sleepmargin = tmfreq * SLEEPMARGINMAX / 1000;
+    }
+
+    while (now < deadline)
+        now = TM_Now();
+}
+
+/*
+===================
+=
+= TM_WaitForTic
+=
+= Waits until the given tic has started
+=
+===================
+*/
+
+void TM_WaitForTic(int32_t tic)
+{
+    TM_WaitUntil(TM_TicDeadline(tic));
+}
+
+/*
+===================
+=
+= TM_WaitNextTic
+=
+= Waits for the start of the next tic, for loops polling the input
+=
+===================
+*/
+
+void TM_WaitNextTic(void)
+{
+    TM_WaitForTic(GetTimeCount() + 1);
+}
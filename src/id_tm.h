@@ -0,0 +1,33 @@
+//
+//  ID Engine
+//  ID_TM.h - Header file for Timer Manager
+//
+
+#ifndef __ID_TM__
+#define __ID_TM__
+
+#define TICRATE 70 // Wolf tics per second
+
+//
+// all times are in performance counter ticks since TM_Startup
+//
+extern Uint64 tmfreq;
+
+void TM_Startup(void);
+Uint64 TM_Now(void);
+int32_t TM_GetTimeCount(void);
+Uint64 TM_TicDeadline(int32_t tic);
+fixed TM_TicFraction(int32_t tic);
+void TM_WaitUntil(Uint64 deadline);
+void TM_WaitForTic(int32_t tic);
+void TM_WaitNextTic(void);
+
+#define GetTimeCount() TM_GetTimeCount()
+
+inline void Delay(int wolfticks)
+{
+    if (wolfticks > 0)
+        TM_WaitForTic(GetTimeCount() + wolfticks);
+}
+
+#endif
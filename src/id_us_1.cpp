@@ -703,7 +703,7 @@ boolean US_LineInput(int x, int y, char *buf, const char *def, boolean escok, in
             cursorvis ^= true;
         }
         else
-            SDL_Delay(5);
+            TM_WaitNextTic();
         if (cursorvis)
             USL_XORICursor(x, y, s, cursor);
 
@@ -347,6 +347,8 @@ boolean FizzleFade(SDL_Surface *source, int x1, int y1, unsigned width, unsigned
 
     frame = GetTimeCount();
 
+    SDL_VL_UpdateRgbaSurface(); // the screen we fizzle from
+
     byte *srcptr = VL_LockSurface(source);
     do
     {
@@ -423,7 +425,7 @@ boolean FizzleFade(SDL_Surface *source, int x1, int y1, unsigned width, unsigned
         SDL_VL_Present();
 
         frame++;
-        Delay(frame - GetTimeCount()); // don't go too fast
+        TM_WaitForTic(frame); // don't go too fast
     } while (1);
 
 finished:
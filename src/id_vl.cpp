@@ -23,6 +23,9 @@
 boolean fullscreen = true;
 
 boolean usedoublebuffering = true;
+boolean usevsync = true;
+boolean offscreen = false; // render without a window, e.g. for --timedemo
+boolean zerocopypresent = true;
 unsigned screenWidth = 640;
 unsigned screenHeight = 400;
 unsigned screenBits = 32;
@@ -90,7 +93,7 @@ void VL_SetVGAPlaneMode(void)
     title = "Wolfenstein 3D";
 #endif
 
-    SDL_VL_Init(title, screenWidth, screenHeight, fullscreen);
+    SDL_VL_Init(title, screenWidth, screenHeight, fullscreen, usevsync, offscreen, zerocopypresent);
 
     SDL_VL_SetPaletteColors(gamepal);
     memcpy(curpal, gamepal, sizeof(SDL_Color) * 256);
@@ -235,6 +238,42 @@ void VL_SetPalette(SDL_Color *palette, bool forceupdate)
 
 //===========================================================================
 
+/*
+=================
+=
+= VL_MapPalette
+=
+= Maps a palette to screen colors in advance, for VL_SetPaletteLut
+=
+=================
+*/
+
+void VL_MapPalette(SDL_Color *palette, uint32_t *lut)
+{
+    SDL_VL_MapPaletteColors(palette, lut);
+}
+
+/*
+=================
+=
+= VL_SetPaletteLut
+=
+= Switches to a palette mapped by VL_MapPalette. The colors are copied
+= but not remapped, the next frame is converted with the table. The
+= table has to stay around until another palette is set.
+=
+=================
+*/
+
+void VL_SetPaletteLut(SDL_Color *palette, const uint32_t *lut)
+{
+    memcpy(curpal, palette, sizeof(SDL_Color) * 256);
+
+    SDL_VL_SelectPaletteLut(palette, lut);
+}
+
+//===========================================================================
+
 /*
 =================
 =
@@ -262,93 +301,198 @@ void VL_GetPalette(SDL_Color *palette)
 
 void VL_FadeOut(int start, int end, int red, int green, int blue, int steps)
 {
-    int i, j, orig, delta;
-    SDL_Color *origptr, *newptr;
+    VL_StartFadeOut(start, end, red, green, blue, steps);
+    VL_FinishFade();
+}
+
+/*
+=================
+=
+= VL_FadeIn
+=
+=================
+*/
+
+void VL_FadeIn(int start, int end, SDL_Color *palette, int steps)
+{
+    VL_StartFadeIn(start, end, palette, steps);
+    VL_FinishFade();
+}
+
+/*
+=============================================================================
+
+                            TIMED FADES
+
+        A fade takes one step every tic of the id_tm clock, however often
+        it is updated, so the time spent around it is taken out of the
+        fade instead of being added to it. The blocking fades above wait
+        for each step, the play loop advances one a frame at a time.
+
+=============================================================================
+*/
+
+static boolean fadeactive;
+static boolean fadingout; // screenfaded is set when the fade is done
+static int fadestart, fadeend;
+static int fadesteps, fadestep; // fadestep is the step the palette shows
+static Uint64 fadebegin;
+static SDL_Color fadeto[256];
+static int fadedelta[256][3]; // fadeto - palette1, per channel
 
-    red = red * 255 / 63;
-    green = green * 255 / 63;
-    blue = blue * 255 / 63;
+/*
+=================
+=
+= StartFade
+=
+= Fades from the current palette (kept in palette1) to fadeto
+=
+=================
+*/
+
+static void StartFade(int start, int end, int steps)
+{
+    int i;
 
-    VL_WaitVBL(1);
     VL_GetPalette(palette1);
-    memcpy(palette2, palette1, sizeof(SDL_Color) * 256);
 
-    //
-    // fade through intermediate frames
-    //
-    for (i = 0; i < steps; i++)
+    for (i = start; i <= end; i++)
     {
-        origptr = &palette1[start];
-        newptr = &palette2[start];
-        for (j = start; j <= end; j++)
-        {
-            orig = origptr->r;
-            delta = red - orig;
-            newptr->r = orig + delta * i / steps;
-            orig = origptr->g;
-            delta = green - orig;
-            newptr->g = orig + delta * i / steps;
-            orig = origptr->b;
-            delta = blue - orig;
-            newptr->b = orig + delta * i / steps;
-            origptr++;
-            newptr++;
-        }
-
-        if (!usedoublebuffering || screenBits == 8)
-            VL_WaitVBL(1);
-        VL_SetPalette(palette2, true);
+        fadedelta[i][0] = fadeto[i].r - palette1[i].r;
+        fadedelta[i][1] = fadeto[i].g - palette1[i].g;
+        fadedelta[i][2] = fadeto[i].b - palette1[i].b;
     }
 
+    fadestart = start;
+    fadeend = end;
     //
-    // final color
+    // nothing to see without a window, and a timed demo must not play on
+    // untimed while the screen fades in
     //
-    VL_FillPalette(red, green, blue);
+    fadesteps = offscreen || timedemo ? 0 : steps;
+    fadestep = -1;
+    fadebegin = TM_Now();
+    fadeactive = true;
+}
+
+/*
+=================
+=
+= VL_StartFadeOut
+=
+= Starts fading the current palette to the given color, replacing a fade
+= still in progress
+=
+=================
+*/
+
+void VL_StartFadeOut(int start, int end, int red, int green, int blue, int steps)
+{
+    int i;
+
+    for (i = 0; i < 256; i++)
+    {
+        fadeto[i].r = red * 255 / 63;
+        fadeto[i].g = green * 255 / 63;
+        fadeto[i].b = blue * 255 / 63;
+    }
 
-    screenfaded = true;
+    fadingout = true;
+    StartFade(start, end, steps);
 }
 
 /*
 =================
 =
-= VL_FadeIn
+= VL_StartFadeIn
 =
 =================
 */
 
-void VL_FadeIn(int start, int end, SDL_Color *palette, int steps)
+void VL_StartFadeIn(int start, int end, SDL_Color *palette, int steps)
 {
-    int i, j, delta;
+    memcpy(fadeto, palette, sizeof(SDL_Color) * 256);
 
-    VL_WaitVBL(1);
-    VL_GetPalette(palette1);
-    memcpy(palette2, palette1, sizeof(SDL_Color) * 256);
+    fadingout = false;
+    StartFade(start, end, steps);
+}
 
-    //
-    // fade through intermediate frames
-    //
-    for (i = 0; i < steps; i++)
-    {
-        for (j = start; j <= end; j++)
-        {
-            delta = palette[j].r - palette1[j].r;
-            palette2[j].r = palette1[j].r + delta * i / steps;
-            delta = palette[j].g - palette1[j].g;
-            palette2[j].g = palette1[j].g + delta * i / steps;
-            delta = palette[j].b - palette1[j].b;
-            palette2[j].b = palette1[j].b + delta * i / steps;
-        }
+/*
+=================
+=
+= VL_UpdateFade
+=
+= Sets the palette of the step the fade has reached, shown by the next
+= present unless forceupdate. Nothing is done until the next step is due.
+= Returns false once the fade is done and the final palette is set.
+=
+=================
+*/
+
+boolean VL_UpdateFade(bool forceupdate)
+{
+    int i, step, weight;
+
+    if (!fadeactive)
+        return false;
 
-        if (!usedoublebuffering || screenBits == 8)
-            VL_WaitVBL(1);
-        VL_SetPalette(palette2, true);
+    step = (int)((TM_Now() - fadebegin) * TICRATE / tmfreq);
+    if (step >= fadesteps)
+    {
+        VL_SetPalette(fadeto, forceupdate);
+        screenfaded = fadingout;
+        fadeactive = false;
+        return false;
     }
 
+    if (step == fadestep)
+        return true;
+    fadestep = step;
+
     //
-    // final color
+    // one divide for the whole palette, the colors only scale the deltas
     //
-    VL_SetPalette(palette, true);
-    screenfaded = false;
+    weight = step * 256 / fadesteps;
+
+    memcpy(palette2, palette1, sizeof(SDL_Color) * 256);
+    for (i = fadestart; i <= fadeend; i++)
+    {
+        palette2[i].r = palette1[i].r + ((fadedelta[i][0] * weight) >> 8);
+        palette2[i].g = palette1[i].g + ((fadedelta[i][1] * weight) >> 8);
+        palette2[i].b = palette1[i].b + ((fadedelta[i][2] * weight) >> 8);
+    }
+
+    VL_SetPalette(palette2, forceupdate);
+    return true;
+}
+
+/*
+=================
+=
+= VL_FinishFade
+=
+= Shows the rest of a fade in progress and returns when it is done
+=
+=================
+*/
+
+void VL_FinishFade(void)
+{
+    while (VL_UpdateFade(true))
+        TM_WaitUntil(fadebegin + (fadestep + 1) * tmfreq / TICRATE);
+}
+
+/*
+=================
+=
+= VL_FadeActive
+=
+=================
+*/
+
+boolean VL_FadeActive(void)
+{
+    return fadeactive;
 }
 
 /*
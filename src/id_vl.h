@@ -21,7 +21,7 @@ void Quit(const char *error, ...);
 
 extern SDL_Surface *curSurface;
 
-extern boolean fullscreen, usedoublebuffering;
+extern boolean fullscreen, usedoublebuffering, usevsync, offscreen, zerocopypresent;
 extern unsigned screenWidth, screenHeight, screenBits, screenPitch, bufferPitch, curPitch;
 extern unsigned scaleFactor;
 
@@ -36,7 +36,10 @@ extern SDL_Color gamepal[256];
 // VGA hardware routines
 //
 
-#define VL_WaitVBL(a) SDL_Delay((a)*8)
+//
+// a VBL is 8 ms, as it was with SDL_Delay, waited out on the id_tm clock
+//
+#define VL_WaitVBL(a) TM_WaitUntil(TM_Now() + (Uint64)(a) * tmfreq / 125)
 
 void VL_SetVGAPlaneMode(void);
 void VL_SetTextMode(void);
@@ -47,9 +50,16 @@ void VL_FillPalette(int red, int green, int blue);
 void VL_SetColor(int color, int red, int green, int blue);
 void VL_GetColor(int color, int *red, int *green, int *blue);
 void VL_SetPalette(SDL_Color *palette, bool forceupdate);
+void VL_MapPalette(SDL_Color *palette, uint32_t *lut);
+void VL_SetPaletteLut(SDL_Color *palette, const uint32_t *lut);
 void VL_GetPalette(SDL_Color *palette);
 void VL_FadeOut(int start, int end, int red, int green, int blue, int steps);
 void VL_FadeIn(int start, int end, SDL_Color *palette, int steps);
+void VL_StartFadeOut(int start, int end, int red, int green, int blue, int steps);
+void VL_StartFadeIn(int start, int end, SDL_Color *palette, int steps);
+boolean VL_UpdateFade(bool forceupdate);
+void VL_FinishFade(void);
+boolean VL_FadeActive(void);
 
 byte *VL_LockSurface(SDL_Surface *surface);
 void VL_UnlockSurface(SDL_Surface *surface);
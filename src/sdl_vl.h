@@ -10,13 +10,18 @@
 extern SDL_Surface *g_rgbaSurface;
 extern SDL_Surface *g_paletteSurface;
 
-void SDL_VL_Init(const char *title, int originalWidth, int originalHeight, bool fullscreen);
+void SDL_VL_Init(const char *title, int originalWidth, int originalHeight, bool fullscreen, bool vsync,
+                 bool offscreen, bool zeroCopy);
 void SDL_VL_Destroy();
 
 void SDL_VL_SetPaletteColors(SDL_Color *colors);
+void SDL_VL_MapPaletteColors(SDL_Color *colors, Uint32 *lut);
+void SDL_VL_SelectPaletteLut(SDL_Color *colors, const Uint32 *lut);
 void SDL_VL_SetSurfacePalette(SDL_Surface *surface);
 
 void SDL_VL_BlitIndexedSurfaceToScreen();
+void SDL_VL_UpdateRgbaSurface();
+void SDL_VL_BenchmarkConversion(int iterations);
 void SDL_VL_Present();
 
 #endif // SDL_VL_H
@@ -14,6 +14,13 @@
 statobj_t statobjlist[MAXSTATS];
 statobj_t *laststatobj;
 
+//
+// static objects bucketed by tile, so the sprite pass only has to look at
+// the tiles the rays have seen. Both hold statobjlist indices, -1 ends a list
+//
+short statfirst[MAPSIZE][MAPSIZE];
+short statnext[MAXSTATS];
+
 struct
 {
     short picnum;
@@ -124,6 +131,77 @@ struct
 void InitStaticList(void)
 {
     laststatobj = &statobjlist[0];
+    memset(statfirst, -1, sizeof(statfirst));
+}
+
+/*
+===============
+=
+= LinkStatic
+=
+= Adds a static object to the list of its tile, keeping the list in
+= statobjlist order so objects are gathered in the same order as before
+=
+===============
+*/
+
+void LinkStatic(statobj_t *stat)
+{
+    short num = (short)(stat - statobjlist);
+    short *link = &statfirst[stat->tilex][stat->tiley];
+
+    while (*link != -1 && *link < num)
+        link = &statnext[*link];
+
+    statnext[num] = *link;
+    *link = num;
+}
+
+/*
+===============
+=
+= UnlinkStatic
+=
+===============
+*/
+
+void UnlinkStatic(statobj_t *stat)
+{
+    short num = (short)(stat - statobjlist);
+    short *link = &statfirst[stat->tilex][stat->tiley];
+
+    while (*link != -1)
+    {
+        if (*link == num)
+        {
+            *link = statnext[num];
+            return;
+        }
+        link = &statnext[*link];
+    }
+}
+
+/*
+===============
+=
+= BuildStaticIndex
+=
+= Rebuilds the tile lists from statobjlist after a saved game is loaded
+=
+===============
+*/
+
+void BuildStaticIndex(void)
+{
+    statobj_t *statptr;
+
+    memset(statfirst, -1, sizeof(statfirst));
+
+    for (statptr = &statobjlist[0]; statptr != laststatobj; statptr++)
+    {
+        if (statptr->shapenum != -1)
+            LinkStatic(statptr);
+    }
 }
 
 /*
@@ -177,6 +255,7 @@ void SpawnStatic(int tilex, int tiley, int type)
 
     laststatobj->flags |= statinfo[type].specialFlags;
 
+    LinkStatic(laststatobj);
     laststatobj++;
 
     if (laststatobj == &statobjlist[MAXSTATS])
@@ -236,6 +315,8 @@ void PlaceItemType(int itemtype, int tilex, int tiley)
     spot->visspot = &spotvis[tilex][tiley];
     spot->flags = FL_BONUS | statinfo[type].specialFlags;
     spot->itemnumber = statinfo[type].type;
+
+    LinkStatic(spot);
 }
 
 /*
@@ -373,6 +454,7 @@ void SpawnDoor(int tilex, int tiley, boolean vertical, int lock)
         tilemap[tilex - 1][tiley] |= 0x40;
         tilemap[tilex + 1][tiley] |= 0x40;
     }
+    MarkWorldChanged();
 
     doornum++;
     lastdoorobj++;
@@ -591,6 +673,7 @@ void DoorOpening(int door)
     }
 
     doorposition[door] = (word)position;
+    MarkWorldChanged();
 }
 
 /*
@@ -658,6 +741,7 @@ void DoorClosing(int door)
     }
 
     doorposition[door] = (word)position;
+    MarkWorldChanged();
 }
 
 /*
@@ -751,6 +835,7 @@ void PushWall(int checkx, int checky, int dir)
     *(mapsegs[1] + (pwally << mapshift) + pwallx) = 0; // remove P tile info
     *(mapsegs[0] + (pwally << mapshift) + pwallx) =
         *(mapsegs[0] + (player->tiley << mapshift) + player->tilex); // set correct floorcode (BrotherTank's fix)
+    MarkWorldChanged();
 
     SD_PlaySound(PUSHWALLSND);
 }
@@ -773,6 +858,7 @@ void MovePWalls(void)
     oldblock = pwallstate / 128;
 
     pwallstate += (word)tics;
+    MarkWorldChanged();
 
     if (pwallstate / 128 != oldblock)
     {
@@ -829,6 +829,7 @@ void GetBonus(statobj_t *check)
     }
 
     StartBonusFlash();
+    UnlinkStatic(check);
     check->shapenum = -1; // remove from list
 }
 
@@ -1151,6 +1152,7 @@ void Cmd_Use(void)
         buttonheld[bt_use] = true;
 
         tilemap[checkx][checky]++; // flip switch
+        MarkWorldChanged();
         if (*(mapsegs[0] + (player->tiley << mapshift) + player->tilex) == ALTELEVATORTILE)
             playstate = ex_secretlevel;
         else
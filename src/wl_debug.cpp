@@ -17,8 +17,8 @@
 =============================================================================
 */
 
-#define VIEWTILEX (viewwidth / 16)
-#define VIEWTILEY (viewheight / 16)
+#define VIEWTILEX (viewscreenwidth / 16)
+#define VIEWTILEY (viewscreenheight / 16)
 
 /*
 =============================================================================
@@ -424,6 +424,18 @@ int DebugKeys(void)
     boolean esc;
     int level;
 
+    if (Keyboard[sc_A]) // A = phase profiler
+    {
+        CenterWindow(22, 2);
+        if (profoverlay)
+            US_PrintCentered("Phase profiler OFF");
+        else
+            US_PrintCentered("Phase profiler ON");
+        VW_UpdateScreen();
+        IN_Ack();
+        profoverlay ^= 1;
+        return 1;
+    }
     if (Keyboard[sc_B]) // B = border color
     {
         CenterWindow(20, 3);
@@ -637,6 +649,18 @@ int DebugKeys(void)
     }
     else if (Keyboard[sc_Q]) // Q = fast quit
         Quit(NULL);
+    else if (Keyboard[sc_R]) // R = column-major 3D view
+    {
+        CenterWindow(22, 2);
+        if (columnmajorview)
+            US_PrintCentered("Column-major view OFF");
+        else
+            US_PrintCentered("Column-major view ON");
+        VW_UpdateScreen();
+        IN_Ack();
+        columnmajorview ^= 1;
+        return 1;
+    }
     else if (Keyboard[sc_S]) // S = slow motion
     {
         CenterWindow(30, 3);
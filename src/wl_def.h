@@ -78,6 +78,7 @@ void Quit(const char *errorStr, ...);
 #include "id_in.h"
 #include "id_pm.h"
 #include "id_sd.h"
+#include "id_tm.h"
 #include "id_us.h"
 #include "id_vh.h"
 #include "id_vl.h"
@@ -201,6 +202,11 @@ void Quit(const char *errorStr, ...);
 
 #define STATUSLINES 40
 
+#define RENDERSCALEFULL 16 // renderscale of a view rendered at the size it is shown
+#define RENDERSCALEMIN 8   // dynamic resolution goes down to half the size
+
+#define MAXDETAILSHIFT 2 // the lowest detail casts every fourth column
+
 #define SCREENSIZE (SCREENBWIDE * 208)
 #define PAGE1START 0
 #define PAGE2START (SCREENSIZE)
@@ -1250,8 +1256,12 @@ extern int mapon;
 extern boolean loadedgame;
 extern fixed focallength;
 extern int viewscreenx, viewscreeny;
+extern int viewscreenwidth, viewscreenheight;
 extern int viewwidth;
 extern int viewheight;
+extern int renderscale;
+extern int detailshift;
+extern fixed detailxscale;
 extern short centerx;
 extern int32_t heightnumerator;
 extern fixed scale;
@@ -1281,11 +1291,15 @@ extern int param_audiobuffer;
 extern int param_mission;
 extern boolean param_goodtimes;
 extern boolean param_ignorenumchunks;
+extern int param_timedemo;
+extern int param_renderthreads;
+extern int param_detail;
 
 void NewGame(int difficulty, int episode);
 void CalcProjection(int32_t focal);
 void NewViewSize(int width);
 boolean SetViewSize(unsigned width, unsigned height);
+void SetRenderScale(int newscale);
 boolean LoadTheGame(FILE *file, int x, int y);
 boolean SaveTheGame(FILE *file, int x, int y);
 void ShowViewSize(int width);
@@ -1314,6 +1328,10 @@ void ShowActStatus();
 
 void PlayDemo(int demonumber);
 void RecordDemo(void);
+void TimeDemo(int demonumber);
+void TimeDemoFrame(Uint64 frameticks);
+
+extern boolean timedemo;
 
 #ifdef SPEAR
 extern int32_t spearx, speary;
@@ -1348,11 +1366,22 @@ void UpdateSoundLoc(void);
 
 extern byte tilemap[MAPSIZE][MAPSIZE]; // wall values only
 extern byte spotvis[MAPSIZE][MAPSIZE];
+extern uint32_t worldchanges; // bumped by every write to tilemap, doorposition or the pushwall
+
+//
+// anything changing what the walls look like calls this, so the 3D refresh
+// knows when it can reuse the walls of the last frame
+//
+static inline void MarkWorldChanged(void)
+{
+    worldchanges++;
+}
 extern objtype *actorat[MAPSIZE][MAPSIZE];
 
 extern objtype *player;
 
 extern unsigned tics;
+extern boolean uncapped;
 extern int viewsize;
 
 extern int lastgamemusicoffset;
@@ -1369,6 +1398,8 @@ extern exit_t playstate;
 extern boolean madenoise;
 extern statobj_t statobjlist[MAXSTATS];
 extern statobj_t *laststatobj;
+extern short statfirst[MAPSIZE][MAPSIZE];
+extern short statnext[MAXSTATS];
 extern objtype *newobj, *killerobj;
 extern doorobj_t doorobjlist[MAXDOORS];
 extern doorobj_t *lastdoorobj;
@@ -1464,12 +1495,35 @@ extern int32_t frameon;
 extern unsigned screenloc[3];
 
 extern boolean fizzlein, fpscounter;
+extern int numvisiblesprites;
 
 extern fixed viewx, viewy; // the focal point
 extern fixed viewsin, viewcos;
 
+extern int numrenderthreads;
+extern boolean scalertables;
+extern boolean heighttables;
+extern boolean spritespans;
+extern boolean columnmajorview;
+extern boolean dynamicres;
+extern double dynrestarget;
+extern boolean interpolating;
+extern boolean fusedfill;
+extern boolean framereuse;
+extern int reusedframes;
+extern uint32_t pixelswritten;
+
 void ThreeDRefresh(void);
+void UpdateVisibility(void);
+void CalcViewVariables(void);
 void CalcTics(void);
+void InitRenderThreads(int count);
+void SetupHeightTable(void);
+void SetupScalers(void);
+void SetupSpriteSpans(void);
+void BenchmarkSprites(int iterations);
+void BenchmarkRays(int iterations);
+void ShutdownRenderThreads(void);
 
 typedef struct
 {
@@ -1571,6 +1625,9 @@ extern byte pwalldir, pwalltile;
 void InitDoorList(void);
 void InitStaticList(void);
 void SpawnStatic(int tilex, int tiley, int type);
+void LinkStatic(statobj_t *stat);
+void UnlinkStatic(statobj_t *stat);
+void BuildStaticIndex(void);
 void SpawnDoor(int tilex, int tiley, boolean vertical, int lock);
 void MoveDoors(void);
 void MovePWalls(void);
@@ -1686,6 +1743,42 @@ extern char helpfilename[], endfilename[];
 extern void HelpScreens(void);
 extern void EndText(void);
 
+/*
+=============================================================================
+
+                             WL_PROF DEFINITIONS
+
+=============================================================================
+*/
+
+typedef enum
+{
+    prof_clear,    // VGAClearScreen
+    prof_walls,    // WallRefresh
+    prof_scaleds,  // DrawScaleds
+    prof_weapon,   // DrawPlayerWeapon
+    prof_blit,     // palette conversion of the screen
+    prof_present,  // SDL_VL_Present
+    prof_think,    // doors, pushwalls and actors in PlayLoop
+    prof_controls, // PollControls
+    NUMPROFPHASES
+} profphase_t;
+
+extern boolean profoverlay;
+
+void ProfileOpenCSV(const char *filename);
+void ProfileShutdown(void);
+void ProfileStartFrame(void);
+void ProfileEndFrame(void);
+void ProfileBegin(profphase_t phase);
+void ProfileEnd(void);
+void DrawProfileOverlay(void);
+
+void TraceOpen(const char *filename);
+void TraceShutdown(void);
+void TraceBegin(const char *name);
+void TraceEnd(void);
+
 /*
 =============================================================================
 
@@ -3,6 +3,11 @@
 #include "wl_def.h"
 #pragma hdrstop
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
 /*
 =============================================================================
 
@@ -25,7 +30,80 @@
 */
 
 static byte *vbuf = NULL;
-unsigned vbufPitch = 0;
+unsigned vbufPitch = 0;   // offset between two rows in vbuf
+static unsigned vbufStep; // offset between two columns in vbuf
+
+//
+// column-major render target for the 3D view, transposed into the screen
+// at the end of the 3D refresh
+//
+boolean columnmajorview;
+static byte *viewcolumns;
+static unsigned viewcolumnspitch;
+static int viewcolumnswidth, viewcolumnsheight;
+
+//
+// dynamic resolution: renderscale is lowered while ThreeDRefresh takes
+// longer than dynrestarget milliseconds and raised again when there is room
+//
+#define DYNRESFRAMES 16   // frames averaged before the render scale is changed
+#define DYNRESMARGIN 0.85 // the next larger scale has to fit in this much of the target
+
+boolean dynamicres;
+double dynrestarget = 8.0;
+static Uint64 dynresticks;
+static int dynresframes;
+static byte *scaledview; // the view at render size, stretched to the screen afterwards
+static int scaledviewsize;
+
+//
+// uncapped rendering: UpdateVisibility traces the view without drawing it,
+// interpolating is set while a frame between two tics is drawn
+//
+static boolean visibilityonly;
+boolean interpolating;
+
+//
+// fused floor/ceiling fill: the wall pass fills the rows above and below
+// each post, instead of VGAClearScreen clearing the whole view beforehand
+//
+#define FLOORCOLOR 0x19
+
+boolean fusedfill;
+static byte fillceiling; // ceiling color of the level being drawn
+
+//
+// frame reuse: the view before sprites and weapon are drawn is kept, with
+// everything the wall pass leaves behind, and used again as long as the view
+// and the walls stay the same
+//
+typedef struct
+{
+    boolean valid;
+    fixed viewx, viewy;
+    short viewangle;
+    uint32_t worldchanges;
+    int width, height;     // view size,
+    unsigned pitch, step;  // layout
+    int32_t heightnumerator; // and projection it was drawn with
+    byte ceiling;
+
+    byte *pixels;
+    int size;
+    int *wallheight;
+    word vistiles[MAPSIZE * MAPSIZE];
+    int numvistiles;
+    int minheight;
+    uint32_t pixelswritten;
+} walllayer_t;
+
+boolean framereuse;
+static walllayer_t walllayer;
+int reusedframes; // 3D refreshes that reused the wall layer
+
+uint32_t pixelswritten;          // view pixels written by the last 3D refresh
+static thread_local uint32_t raypixels; // the part of them written by the wall pass of a thread
+static boolean countpixels;             // only counted for --timedemo and the fps overlay, once a post
 
 int32_t lasttimecount;
 int32_t frameon;
@@ -34,7 +112,7 @@ boolean fpscounter;
 int fps_frames = 0, fps_time = 0, fps = 0;
 
 int *wallheight;
-int min_wallheight;
+thread_local int min_wallheight;
 
 //
 // math tables
@@ -44,6 +122,24 @@ int32_t finetangent[FINEANGLES / 4];
 fixed sintable[ANGLES + ANGLES / 4];
 fixed *costable = sintable + (ANGLES / 4);
 
+//
+// height table: heighttable[z >> 8] holds heightnumerator / (z >> 8), rebuilt
+// by SetupHeightTable whenever the projection changes
+//
+#define MAXHEIGHTDIST ((MAPSIZE * 3 / 2) << (TILESHIFT - 8)) // past the farthest wall of a map
+
+boolean heighttables = true;
+static int32_t *heighttable;
+
+static inline int32_t ProjectHeight(fixed z)
+{
+    int32_t dist = z >> 8;
+
+    if (heighttables && dist < MAXHEIGHTDIST)
+        return heighttable[dist];
+    return heightnumerator / dist;
+}
+
 //
 // refresh variables
 //
@@ -61,11 +157,12 @@ void ThreeDRefresh(void);
 
 //
 // wall optimization variables
+// (per thread, as the wall refresh may be split across render threads)
 //
-int lastside; // true for vertical
-int32_t lastintercept;
-int lasttilehit;
-int lasttexture;
+thread_local int lastside; // true for vertical
+thread_local int32_t lastintercept;
+thread_local int lasttilehit;
+thread_local int lasttexture;
 
 //
 // ray tracing variables
@@ -75,15 +172,43 @@ longword xpartialup, xpartialdown, ypartialup, ypartialdown;
 
 short midangle, angle;
 
-word tilehit;
-int pixx;
+thread_local word tilehit;
+thread_local int pixx;
+
+thread_local short xtile, ytile;
+thread_local short xtilestep, ytilestep;
+thread_local int32_t xintercept, yintercept;
+thread_local word xspot, yspot;
+thread_local int texdelta;
+thread_local byte *rayspotvis; // spotvis, or the private copy of a render thread
+thread_local word *raytiles;    // spots newly marked in rayspotvis
+thread_local int numraytiles;
+
+word vistiles[MAPSIZE * MAPSIZE]; // every spot set in spotvis this frame
+int numvistiles;
+
+//
+// render threads
+//
+#define MAXRENDERTHREADS 16
+#define MINBANDWIDTH 64 // don't split the view into narrower column bands
 
-short xtile, ytile;
-short xtilestep, ytilestep;
-int32_t xintercept, yintercept;
-word xstep, ystep;
-word xspot, yspot;
-int texdelta;
+typedef struct
+{
+    SDL_Thread *thread;
+    SDL_sem *start;
+    int startx, endx;
+    int minheight;
+    uint32_t pixels;
+    byte spotvis[MAPSIZE][MAPSIZE];
+    word tiles[MAPSIZE * MAPSIZE];
+    int numtiles;
+} renderband_t;
+
+int numrenderthreads;
+static renderband_t *renderbands[MAXRENDERTHREADS];
+static SDL_sem *renderbandsdone;
+static volatile boolean renderthreadsquit;
 
 word horizwall[MAXWALLTILES], vertwall[MAXWALLTILES];
 
@@ -160,7 +285,7 @@ void TransformActor(objtype *ob)
     //
     // calculate height (heightnumerator/(nx>>8))
     //
-    ob->viewheight = (word)(heightnumerator / (nx >> 8));
+    ob->viewheight = (word)ProjectHeight(nx);
 }
 
 //==========================================================================
@@ -218,7 +343,7 @@ boolean TransformTile(int tx, int ty, short *dispx, short *dispheight)
     else
     {
         *dispx = (short)(centerx + ny * scale / nx);
-        *dispheight = (short)(heightnumerator / (nx >> 8));
+        *dispheight = (short)ProjectHeight(nx);
     }
 
     //
@@ -232,6 +357,32 @@ boolean TransformTile(int tx, int ty, short *dispx, short *dispheight)
 
 //==========================================================================
 
+/*
+====================
+=
+= SetupHeightTable
+=
+= Divides heightnumerator by every distance a wall or an object in the map
+= can be at, so the refresh only has to look the heights up
+=
+====================
+*/
+
+void SetupHeightTable(void)
+{
+    int32_t dist;
+
+    if (!heighttable)
+    {
+        heighttable = (int32_t *)malloc(MAXHEIGHTDIST * sizeof(int32_t));
+        CHECKMALLOCRESULT(heighttable);
+    }
+
+    heighttable[0] = 0; // nothing gets closer than MINDIST
+    for (dist = 1; dist < MAXHEIGHTDIST; dist++)
+        heighttable[dist] = heightnumerator / dist;
+}
+
 /*
 ====================
 =
@@ -249,7 +400,7 @@ int CalcHeight()
     if (z < MINDIST)
         z = MINDIST;
 
-    int height = heightnumerator / (z >> 8);
+    int height = ProjectHeight(z);
 
     if (height < min_wallheight)
         min_wallheight = height;
@@ -267,13 +418,209 @@ int CalcHeight()
 ===================
 */
 
-byte *postsource;
-int postx;
+thread_local byte *postsource;
+thread_local int postx;
+
+//
+// scaler tables, rebuilt by SetupScalers whenever the projection changes
+//
+typedef struct
+{
+    int firstrow; // first view row drawn
+    int numrows;  // number of rows drawn
+    byte *texels; // texel index for each drawn row
+} postscaler_t;
+
+boolean scalertables = true;
+
+static postscaler_t *postscalers;
+static byte *postscalertexels;
+static int maxpostscale;
+
+static short *spritescalers;
+static int maxspritescale;
+
+//
+// sprite posts decoded by SetupSpriteSpans: the spans of column i of a
+// sprite are spritespanarena[columns[i - leftpix]] up to
+// spritespanarena[columns[i - leftpix + 1]]
+//
+#define BENCHSPRITES 256 // sprites drawn in each BenchmarkSprites iteration
+
+typedef struct
+{
+    byte *texels;      // texel of row starty in the VSWAP page
+    byte starty, endy; // texel rows starty up to endy are drawn
+} spritespan_t;
+
+typedef struct
+{
+    int *columns;
+} spriteshape_t;
+
+boolean spritespans = true;
+
+static spriteshape_t *spriteshapes;
+static int *spritecolumns;
+static spritespan_t *spritespanarena;
+
+void ScalePostLoop();
+static void FillPostGaps(int top, int bottom);
+
+/*
+===================
+=
+= SetupScalers
+=
+= Precomputes for every post height, which texel is drawn on each visible
+= row, exactly like the error accumulator in ScalePostLoop does. Also builds
+= the screen edges of the texels for every sprite scale.
+=
+===================
+*/
+
+void SetupScalers(void)
+{
+    int yd, ywcount, yw, top, row, firstrow, lastrow, numtexels;
+    byte *texels;
+
+    free(postscalers);
+    free(postscalertexels);
+    free(spritescalers);
+
+    //
+    // CalcHeight never lets a post get closer than MINDIST
+    //
+    maxpostscale = (heightnumerator / (MINDIST >> 8)) >> 3;
+
+    postscalers = (postscaler_t *)malloc((maxpostscale + 1) * sizeof(postscaler_t));
+    CHECKMALLOCRESULT(postscalers);
+
+    numtexels = 0;
+    for (yd = 1; yd <= maxpostscale; yd++)
+        numtexels += 2 * yd < viewheight ? 2 * yd : viewheight;
+    postscalertexels = (byte *)malloc(numtexels);
+    CHECKMALLOCRESULT(postscalertexels);
+
+    postscalers[0].firstrow = 0;
+    postscalers[0].numrows = 0;
+    postscalers[0].texels = postscalertexels;
+
+    texels = postscalertexels;
+    for (yd = 1; yd <= maxpostscale; yd++)
+    {
+        top = viewheight / 2 - yd;
+        firstrow = top < 0 ? 0 : top;
+        lastrow = top + 2 * yd - 1 < viewheight ? top + 2 * yd - 1 : viewheight - 1;
+
+        //
+        // walk up from the bottom of the post, stop when the texture runs out
+        //
+        ywcount = yd;
+        yw = TEXTURESIZE - 1;
+        for (row = top + 2 * yd - 1; row >= firstrow && yw >= 0; row--)
+        {
+            if (row <= lastrow)
+                texels[row - firstrow] = (byte)yw;
+
+            ywcount -= TEXTURESIZE / 2;
+            while (ywcount <= 0)
+            {
+                ywcount += yd;
+                yw--;
+            }
+        }
+
+        postscalers[yd].firstrow = row + 1;
+        postscalers[yd].numrows = lastrow > row ? lastrow - row : 0;
+        postscalers[yd].texels = texels + (row + 1 - firstrow);
+        texels += lastrow - firstrow + 1;
+    }
+
+    //
+    // the sprite scalers hold the screen offset of every texel edge
+    //
+    maxspritescale = maxpostscale > viewheight / 2 + 1 ? maxpostscale : viewheight / 2 + 1;
+
+    spritescalers = (short *)malloc((maxspritescale + 1) * (TEXTURESIZE + 1) * sizeof(short));
+    CHECKMALLOCRESULT(spritescalers);
+
+    for (int scale = 0; scale <= maxspritescale; scale++)
+    {
+        short *edges = spritescalers + scale * (TEXTURESIZE + 1);
+        for (int i = 0; i <= TEXTURESIZE; i++)
+            edges[i] = (short)((i * scale * SPRITESCALEFACTOR) >> 6);
+    }
+}
+
+static short *GetSpriteScaler(unsigned scale)
+{
+    static short edges[TEXTURESIZE + 1];
+
+    if (scale <= (unsigned)maxspritescale)
+        return spritescalers + scale * (TEXTURESIZE + 1);
+
+    for (int i = 0; i <= TEXTURESIZE; i++)
+        edges[i] = (short)((i * scale * SPRITESCALEFACTOR) >> 6);
+    return edges;
+}
+
+/*
+===================
+=
+= ScalePost
+=
+= Draws the post with the precomputed scaler of its height
+=
+===================
+*/
 
 void ScalePost()
+{
+    if (visibilityonly)
+        return;
+
+    int yd = wallheight[postx] >> 3;
+
+    if (yd > maxpostscale || !scalertables)
+    {
+        ScalePostLoop();
+        return;
+    }
+    if (yd <= 0)
+    {
+        if (fusedfill)
+            FillPostGaps(viewheight, viewheight);
+        return;
+    }
+
+    postscaler_t *scaler = &postscalers[yd];
+    byte *texels = scaler->texels;
+    byte *dest = vbuf + scaler->firstrow * vbufPitch + postx * vbufStep;
+
+    for (int i = 0; i < scaler->numrows; i++, dest += vbufPitch)
+        *dest = postsource[texels[i]];
+    if (countpixels)
+        raypixels += scaler->numrows;
+
+    if (fusedfill)
+        FillPostGaps(scaler->firstrow, scaler->firstrow + scaler->numrows);
+}
+
+/*
+===================
+=
+= ScalePostLoop
+=
+= Draws the post by stepping through the texture from the bottom
+=
+===================
+*/
+
+void ScalePostLoop()
 {
 
-    int ywcount, yoffs, yw, yd, yendoffs;
+    int ywcount, yoffs, yw, yd, yendoffs, bottom, rows;
     byte col;
 
     ywcount = yd = wallheight[postx] >> 3;
@@ -283,7 +630,7 @@ void ScalePost()
     yoffs = (viewheight / 2 - ywcount) * vbufPitch;
     if (yoffs < 0)
         yoffs = 0;
-    yoffs += postx;
+    yoffs += postx * vbufStep;
 
     yendoffs = viewheight / 2 + ywcount - 1;
     yw = TEXTURESIZE - 1;
@@ -298,15 +645,22 @@ void ScalePost()
         }
         yendoffs--;
     }
+    bottom = yendoffs + 1;
+    rows = 0;
     if (yw < 0)
+    {
+        if (fusedfill)
+            FillPostGaps(bottom, bottom);
         return;
+    }
 
     col = postsource[yw];
 
-    yendoffs = yendoffs * vbufPitch + postx;
+    yendoffs = yendoffs * vbufPitch + postx * vbufStep;
     while (yoffs <= yendoffs)
     {
         vbuf[yendoffs] = col;
+        rows++;
         ywcount -= TEXTURESIZE / 2;
         if (ywcount <= 0)
         {
@@ -321,12 +675,77 @@ void ScalePost()
         }
         yendoffs -= vbufPitch;
     }
+    if (countpixels)
+        raypixels += rows;
+
+    if (fusedfill)
+        FillPostGaps(bottom - rows, bottom);
+}
+
+/*
+===================
+=
+= FillPostGaps
+=
+= Fills the rows of the post column outside the drawn rows top up to
+= bottom, with the colors VGAClearScreen would have put there
+=
+===================
+*/
+
+static void FillColumn(int from, int to)
+{
+    int y, half;
+    byte *dest;
+
+    if (from >= to)
+        return;
+
+    half = viewheight / 2;
+    dest = vbuf + from * vbufPitch + postx * vbufStep;
+
+    if (vbufPitch == 1) // column-major view
+    {
+        y = to < half ? to : half;
+        if (y > from)
+            memset(dest, fillceiling, y - from);
+        else
+            y = from;
+        if (y < to)
+            memset(dest + (y - from), FLOORCOLOR, to - y);
+    }
+    else
+    {
+        for (y = from; y < to && y < half; y++, dest += vbufPitch)
+            *dest = fillceiling;
+        for (; y < to; y++, dest += vbufPitch)
+            *dest = FLOORCOLOR;
+    }
+
+    if (countpixels)
+        raypixels += to - from;
+}
+
+static void FillPostGaps(int top, int bottom)
+{
+    if (top < 0)
+        top = 0;
+    else if (top > viewheight)
+        top = viewheight;
+    if (bottom > viewheight)
+        bottom = viewheight;
+    if (bottom < top)
+        bottom = top;
+
+    FillColumn(0, top);
+    FillColumn(bottom, viewheight);
 }
 
 void GlobalScalePost(byte *vidbuf, unsigned pitch)
 {
     vbuf = vidbuf;
     vbufPitch = pitch;
+    vbufStep = 1;
     ScalePost();
 }
 
@@ -617,14 +1036,27 @@ void VGAClearScreen(void)
 {
     byte ceiling = vgaCeiling[gamestate.episode * 10 + mapon];
 
-    int y;
+    int x, y;
     byte *ptr = vbuf;
 
+    if (countpixels)
+        pixelswritten += viewwidth * viewheight;
+
+    if (columnmajorview)
+    {
+        for (x = 0; x < viewwidth; x++, ptr += vbufStep)
+        {
+            memset(ptr, ceiling, viewheight / 2);
+            memset(ptr + viewheight / 2, FLOORCOLOR, viewheight - viewheight / 2);
+        }
+        return;
+    }
+
     for (y = 0; y < viewheight / 2; y++, ptr += vbufPitch)
         memset(ptr, ceiling, viewwidth);
 
     for (; y < viewheight; y++, ptr += vbufPitch)
-        memset(ptr, 0x19, viewwidth);
+        memset(ptr, FLOORCOLOR, viewwidth);
 }
 
 //==========================================================================
@@ -643,8 +1075,9 @@ int CalcRotate(objtype *ob)
 
     // this isn't exactly correct, as it should vary by a trig value,
     // but it is close enough with only eight rotations
+    // a low detail view counts its columns back in shown pixels first
 
-    viewangle = player->angle + (centerx - ob->viewx) / 8;
+    viewangle = player->angle + (int)(((int64_t)(centerx - ob->viewx) << 16) / detailxscale / 8);
 
     if (ob->obclass == rocketobj || ob->obclass == hrocketobj)
         angle = (viewangle - 180) - ob->angle;
@@ -663,184 +1096,356 @@ int CalcRotate(objtype *ob)
     return angle / (ANGLES / 8);
 }
 
-void ScaleShape(int xcenter, int shapenum, unsigned height, uint32_t flags)
+/*
+===================
+=
+= SetupSpriteSpans
+=
+= Decodes the post commands of every sprite once into a flat table of
+= spans, so drawing a sprite column does not have to parse them again
+=
+===================
+*/
+
+void SetupSpriteSpans(void)
 {
+    int shapenum, numsprites, numcolumns, numspans, i;
     t_compshape *shape;
-    unsigned scale, pixheight;
-    unsigned starty, endy;
-    word *cmdptr;
-    byte *cline;
     byte *line;
-    byte *vmem;
-    int actx, i, upperedge;
+    word endy, starty;
     short newstart;
-    int scrstarty, screndy, lpix, rpix, pixcnt, ycnt;
-    unsigned j;
-    byte col;
-
-    shape = (t_compshape *)PM_GetSprite(shapenum);
-
-    scale = height >> 3; // low three bits are fractional
-    if (!scale)
-        return; // too close or far away
-
-    pixheight = scale * SPRITESCALEFACTOR;
-    actx = xcenter - scale;
-    upperedge = viewheight / 2 - scale;
+    spritespan_t *span;
+    int *columns;
 
-    cmdptr = (word *)shape->dataofs;
+    numsprites = PMSoundStart - PMSpriteStart;
 
-    for (i = shape->leftpix, pixcnt = i * pixheight, rpix = (pixcnt >> 6) + actx; i <= shape->rightpix; i++, cmdptr++)
+    //
+    // count the columns and spans to size the arena
+    //
+    numcolumns = numspans = 0;
+    for (shapenum = 0; shapenum < numsprites; shapenum++)
     {
-        lpix = rpix;
-
-        if (lpix >= viewwidth)
-            break;
+        if (!PM_GetPageSize(PMSpriteStart + shapenum))
+            continue; // sparse page
 
-        pixcnt += pixheight;
-        rpix = (pixcnt >> 6) + actx;
-
-        if (lpix != rpix && rpix > 0)
+        shape = (t_compshape *)PM_GetSprite(shapenum);
+        numcolumns += shape->rightpix - shape->leftpix + 2;
+        for (i = shape->leftpix; i <= shape->rightpix; i++)
         {
-            if (lpix < 0)
-                lpix = 0;
-
-            if (rpix > viewwidth)
-                rpix = viewwidth, i = shape->rightpix + 1;
+            line = (byte *)shape + shape->dataofs[i - shape->leftpix];
+            while (READWORD(line) != 0)
+            {
+                line += 4;
+                numspans++;
+            }
+        }
+    }
 
-            cline = (byte *)shape + *cmdptr;
+    free(spriteshapes);
+    free(spritecolumns);
+    free(spritespanarena);
 
-            while (lpix < rpix)
-            {
-                if (wallheight[lpix] <= (int)height)
-                {
-                    line = cline;
-                    while ((endy = READWORD(line)) != 0)
-                    {
-                        endy >>= 1;
-                        newstart = READWORD(line);
-                        starty = READWORD(line) >> 1;
-                        j = starty;
-                        ycnt = j * pixheight;
-                        screndy = (ycnt >> 6) + upperedge;
-
-                        if (screndy < 0)
-                            vmem = vbuf + lpix;
-                        else
-                            vmem = vbuf + screndy * vbufPitch + lpix;
+    spriteshapes = (spriteshape_t *)calloc(numsprites, sizeof(spriteshape_t));
+    spritecolumns = (int *)malloc(numcolumns * sizeof(int));
+    spritespanarena = (spritespan_t *)malloc(numspans * sizeof(spritespan_t));
+    CHECKMALLOCRESULT(spriteshapes);
+    CHECKMALLOCRESULT(spritecolumns);
+    CHECKMALLOCRESULT(spritespanarena);
 
-                        for (; j < endy; j++)
-                        {
-                            scrstarty = screndy;
-                            ycnt += pixheight;
-                            screndy = (ycnt >> 6) + upperedge;
-                            if (scrstarty != screndy && screndy > 0)
-                            {
-                                col = ((byte *)shape)[newstart + j];
+    columns = spritecolumns;
+    span = spritespanarena;
+    for (shapenum = 0; shapenum < numsprites; shapenum++)
+    {
+        if (!PM_GetPageSize(PMSpriteStart + shapenum))
+            continue;
 
-                                if (scrstarty < 0)
-                                    scrstarty = 0;
+        shape = (t_compshape *)PM_GetSprite(shapenum);
+        spriteshapes[shapenum].columns = columns;
 
-                                if (screndy > viewheight)
-                                    screndy = viewheight, j = endy;
+        for (i = shape->leftpix; i <= shape->rightpix; i++)
+        {
+            *columns++ = (int)(span - spritespanarena);
 
-                                while (scrstarty < screndy)
-                                {
-                                    *vmem = col;
-                                    vmem += vbufPitch;
-                                    scrstarty++;
-                                }
-                            }
-                        }
-                    }
-                }
-                lpix++;
+            line = (byte *)shape + shape->dataofs[i - shape->leftpix];
+            while ((endy = READWORD(line)) != 0)
+            {
+                endy >>= 1;
+                newstart = READWORD(line);
+                starty = READWORD(line) >> 1;
+                if (starty >= endy)
+                    continue; // draws nothing
+
+                span->texels = (byte *)shape + newstart + starty;
+                span->starty = (byte)starty;
+                span->endy = (byte)endy;
+                span++;
             }
         }
+        *columns++ = (int)(span - spritespanarena); // end of the last column
     }
 }
 
-void SimpleScaleShape(int xcenter, int shapenum, unsigned height)
+/*
+===================
+=
+= ScaleSpan
+=
+= Draws the texel rows starty up to endy of a sprite column on screen
+= column lpix, texels holding the texel of row starty
+=
+===================
+*/
+
+static inline void ScaleSpan(int lpix, short *edges, int upperedge, unsigned starty, unsigned endy, byte *texels)
 {
-    t_compshape *shape;
-    unsigned scale, pixheight;
-    unsigned starty, endy;
-    word *cmdptr;
-    byte *cline;
-    byte *line;
-    int actx, i, upperedge;
-    short newstart;
-    int scrstarty, screndy, lpix, rpix, pixcnt, ycnt;
+    int scrstarty, screndy;
     unsigned j;
     byte col;
-    byte *vmem;
+    byte *vmem, *first;
 
-    shape = (t_compshape *)PM_GetSprite(shapenum);
+    j = starty;
+    screndy = edges[j] + upperedge;
 
-    scale = height >> 1;
-    pixheight = scale * SPRITESCALEFACTOR;
-    actx = xcenter - scale;
-    upperedge = viewheight / 2 - scale;
+    if (screndy < 0)
+        vmem = vbuf + lpix * vbufStep;
+    else
+        vmem = vbuf + screndy * vbufPitch + lpix * vbufStep;
+    first = vmem;
+
+    for (; j < endy; j++)
+    {
+        scrstarty = screndy;
+        screndy = edges[j + 1] + upperedge;
+        if (scrstarty != screndy && screndy > 0)
+        {
+            col = texels[j - starty];
+
+            if (scrstarty < 0)
+                scrstarty = 0;
+
+            if (screndy > viewheight)
+                screndy = viewheight, j = endy;
+
+            while (scrstarty < screndy)
+            {
+                *vmem = col;
+                vmem += vbufPitch;
+                scrstarty++;
+            }
+        }
+    }
+
+    //
+    // the rows of a span follow each other, so count them all at once
+    //
+    if (countpixels)
+        pixelswritten += (uint32_t)((vmem - first) / vbufPitch);
+}
+
+/*
+===================
+=
+= ScaleColumn
+=
+= Draws all the posts of sprite column i on screen column lpix, from the
+= decoded spans or by parsing the post commands
+=
+===================
+*/
+
+static inline void ScaleColumn(t_compshape *shape, int shapenum, int i, int lpix, short *edges, int upperedge)
+{
+    byte *line;
+    unsigned starty, endy;
+    short newstart;
+
+    if (spritespans)
+    {
+        int *columns = spriteshapes[shapenum].columns + (i - shape->leftpix);
+        spritespan_t *span = spritespanarena + columns[0];
+        spritespan_t *end = spritespanarena + columns[1];
+
+        for (; span < end; span++)
+            ScaleSpan(lpix, edges, upperedge, span->starty, span->endy, span->texels);
+        return;
+    }
+
+    line = (byte *)shape + shape->dataofs[i - shape->leftpix];
+    while ((endy = READWORD(line)) != 0)
+    {
+        endy >>= 1;
+        newstart = READWORD(line);
+        starty = READWORD(line) >> 1;
+        ScaleSpan(lpix, edges, upperedge, starty, endy, (byte *)shape + newstart + starty);
+    }
+}
+
+//
+// sprite edges are in the pixels the view is shown at, a low detail view has
+// fewer columns
+//
+static inline int DetailX(int x)
+{
+    return detailshift ? (int)(((int64_t)x * detailxscale) >> 16) : x;
+}
+
+void ScaleShape(int xcenter, int shapenum, unsigned height, uint32_t flags)
+{
+    t_compshape *shape;
+    unsigned scale;
+    int actx, i, upperedge;
+    short *edges;
+    int lpix, rpix, column;
+
+    shape = (t_compshape *)PM_GetSprite(shapenum);
+
+    scale = height >> 3; // low three bits are fractional
+    if (!scale)
+        return; // too close or far away
 
-    cmdptr = shape->dataofs;
+    edges = GetSpriteScaler(scale);
+    actx = xcenter - DetailX(scale);
+    upperedge = viewheight / 2 - scale;
 
-    for (i = shape->leftpix, pixcnt = i * pixheight, rpix = (pixcnt >> 6) + actx; i <= shape->rightpix; i++, cmdptr++)
+    for (i = shape->leftpix, rpix = DetailX(edges[i]) + actx; i <= shape->rightpix; i++)
     {
         lpix = rpix;
+
         if (lpix >= viewwidth)
             break;
-        pixcnt += pixheight;
-        rpix = (pixcnt >> 6) + actx;
+
+        rpix = DetailX(edges[i + 1]) + actx;
+
         if (lpix != rpix && rpix > 0)
         {
             if (lpix < 0)
                 lpix = 0;
+
+            column = i;
             if (rpix > viewwidth)
                 rpix = viewwidth, i = shape->rightpix + 1;
-            cline = (byte *)shape + *cmdptr;
+
             while (lpix < rpix)
             {
-                line = cline;
-                while ((endy = READWORD(line)) != 0)
-                {
-                    endy >>= 1;
-                    newstart = READWORD(line);
-                    starty = READWORD(line) >> 1;
-                    j = starty;
-                    ycnt = j * pixheight;
-                    screndy = (ycnt >> 6) + upperedge;
-                    if (screndy < 0)
-                        vmem = vbuf + lpix;
-                    else
-                        vmem = vbuf + screndy * vbufPitch + lpix;
-                    for (; j < endy; j++)
-                    {
-                        scrstarty = screndy;
-                        ycnt += pixheight;
-                        screndy = (ycnt >> 6) + upperedge;
-                        if (scrstarty != screndy && screndy > 0)
-                        {
-                            col = ((byte *)shape)[newstart + j];
-                            if (scrstarty < 0)
-                                scrstarty = 0;
-                            if (screndy > viewheight)
-                                screndy = viewheight, j = endy;
+                if (wallheight[lpix] <= (int)height)
+                    ScaleColumn(shape, shapenum, column, lpix, edges, upperedge);
+                lpix++;
+            }
+        }
+    }
+}
 
-                            while (scrstarty < screndy)
-                            {
-                                *vmem = col;
-                                vmem += vbufPitch;
-                                scrstarty++;
-                            }
-                        }
-                    }
-                }
+void SimpleScaleShape(int xcenter, int shapenum, unsigned height)
+{
+    t_compshape *shape;
+    unsigned scale;
+    int actx, i, upperedge;
+    short *edges;
+    int lpix, rpix, column;
+
+    shape = (t_compshape *)PM_GetSprite(shapenum);
+
+    scale = height >> 1;
+    edges = GetSpriteScaler(scale);
+    actx = xcenter - DetailX(scale);
+    upperedge = viewheight / 2 - scale;
+
+    for (i = shape->leftpix, rpix = DetailX(edges[i]) + actx; i <= shape->rightpix; i++)
+    {
+        lpix = rpix;
+        if (lpix >= viewwidth)
+            break;
+        rpix = DetailX(edges[i + 1]) + actx;
+        if (lpix != rpix && rpix > 0)
+        {
+            if (lpix < 0)
+                lpix = 0;
+            column = i;
+            if (rpix > viewwidth)
+                rpix = viewwidth, i = shape->rightpix + 1;
+            while (lpix < rpix)
+            {
+                ScaleColumn(shape, shapenum, column, lpix, edges, upperedge);
                 lpix++;
             }
         }
     }
 }
 
+/*
+===================
+=
+= BenchmarkSprites
+=
+= Draws a crowd of overlapping sprites with the decoded spans and with the
+= post commands and reports the time each took. Quits with an error when
+= the two pictures differ
+=
+===================
+*/
+
+void BenchmarkSprites(int iterations)
+{
+    int pass, iter, s, numsprites, x, height;
+    boolean mismatch;
+    byte *buffers[2];
+    Uint64 ticks[2];
+    boolean oldspritespans = spritespans;
+
+    numsprites = PMSoundStart - PMSpriteStart;
+
+    for (x = 0; x < viewwidth; x++)
+        wallheight[x] = 0; // nothing hides the sprites
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        buffers[pass] = (byte *)malloc(viewwidth * viewheight);
+        CHECKMALLOCRESULT(buffers[pass]);
+        memset(buffers[pass], 0, viewwidth * viewheight);
+
+        vbuf = buffers[pass];
+        vbufPitch = viewwidth;
+        vbufStep = 1;
+        spritespans = pass == 1;
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (iter = 0; iter < iterations; iter++)
+        {
+            //
+            // a crowd of sprites across the view, from far away up to filling
+            // the screen, every one overlapping its neighbours
+            //
+            for (s = 0; s < BENCHSPRITES; s++)
+            {
+                int shapenum = s % numsprites;
+                if (!PM_GetPageSize(PMSpriteStart + shapenum))
+                    continue;
+
+                x = (s * 37) % viewwidth;
+                height = (8 + (s * 53) % (viewheight * 2)) << 3;
+                ScaleShape(x, shapenum, height, 0);
+            }
+        }
+        ticks[pass] = SDL_GetPerformanceCounter() - start;
+    }
+
+    vbuf = NULL;
+    spritespans = oldspritespans;
+
+    double msperticks = 1000.0 / SDL_GetPerformanceFrequency();
+    LOG_Infof("sprite benchmark: %d sprites x %d iterations at %dx%d", BENCHSPRITES, iterations, viewwidth,
+              viewheight);
+    LOG_Infof("post commands: %.3f ms per iteration", ticks[0] * msperticks / iterations);
+    LOG_Infof("decoded spans: %.3f ms per iteration", ticks[1] * msperticks / iterations);
+
+    mismatch = memcmp(buffers[0], buffers[1], viewwidth * viewheight) != 0;
+    free(buffers[0]);
+    free(buffers[1]);
+
+    if (mismatch)
+        Quit("The decoded sprite spans draw a different picture than the post commands!");
+}
+
 /*
 =====================
 =
@@ -861,11 +1466,58 @@ typedef struct
 } visobj_t;
 
 visobj_t vislist[MAXVISABLE];
-visobj_t *visptr, *visstep, *farthest;
+visobj_t *visptr;
+
+static visobj_t vissorted[MAXVISABLE];
+
+int numvisiblesprites; // objects drawn by the last DrawScaleds
+
+/*
+=====================
+=
+= SortVisList
+=
+= Sorts vislist from far to near (ascending viewheight) with a two pass
+= radix sort. It is stable, so objects of equal height keep their order.
+=
+=====================
+*/
+
+static void SortVisList(int numvisable)
+{
+    int count[256];
+    int i, shift, pos, c;
+    visobj_t *src = vislist;
+    visobj_t *dest = vissorted;
+    visobj_t *swap;
+
+    for (shift = 0; shift < 16; shift += 8)
+    {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < numvisable; i++)
+            count[((word)src[i].viewheight >> shift) & 0xff]++;
+
+        for (i = 0, pos = 0; i < 256; i++)
+        {
+            c = count[i];
+            count[i] = pos;
+            pos += c;
+        }
+
+        for (i = 0; i < numvisable; i++)
+            dest[count[((word)src[i].viewheight >> shift) & 0xff]++] = src[i];
+
+        swap = src;
+        src = dest;
+        dest = swap;
+    }
+
+    // after an even number of passes the result is back in vislist
+}
 
 void DrawScaleds(void)
 {
-    int i, least, numvisable, height;
+    int i, numvisable, statnum;
     byte *tilespot, *visspot;
     unsigned spotloc;
 
@@ -875,31 +1527,33 @@ void DrawScaleds(void)
     visptr = &vislist[0];
 
     //
-    // place static objects
+    // place static objects on the tiles the rays have seen
     //
-    for (statptr = &statobjlist[0]; statptr != laststatobj; statptr++)
+    for (i = 0; i < numvistiles; i++)
     {
-        if ((visptr->shapenum = statptr->shapenum) == -1)
-            continue; // object has been deleted
+        for (statnum = (&statfirst[0][0])[vistiles[i]]; statnum != -1;)
+        {
+            statptr = &statobjlist[statnum];
+            statnum = statnext[statnum]; // GetBonus can unlink statptr
 
-        if (!*statptr->visspot)
-            continue; // not visable
+            visptr->shapenum = statptr->shapenum;
 
-        if (TransformTile(statptr->tilex, statptr->tiley, &visptr->viewx, &visptr->viewheight) &&
-            statptr->flags & FL_BONUS)
-        {
-            GetBonus(statptr);
-            if (statptr->shapenum == -1)
-                continue; // object has been taken
-        }
+            if (TransformTile(statptr->tilex, statptr->tiley, &visptr->viewx, &visptr->viewheight) &&
+                statptr->flags & FL_BONUS && !interpolating)
+            {
+                GetBonus(statptr);
+                if (statptr->shapenum == -1)
+                    continue; // object has been taken
+            }
 
-        if (!visptr->viewheight)
-            continue; // to close to the object
+            if (!visptr->viewheight)
+                continue; // to close to the object
 
-        if (visptr < &vislist[MAXVISABLE - 1]) // don't let it overflow
-        {
-            visptr->flags = (short)statptr->flags;
-            visptr++;
+            if (visptr < &vislist[MAXVISABLE - 1]) // don't let it overflow
+            {
+                visptr->flags = (short)statptr->flags;
+                visptr++;
+            }
         }
     }
 
@@ -954,28 +1608,18 @@ void DrawScaleds(void)
 
     numvisable = (int)(visptr - &vislist[0]);
 
+    if (visibilityonly)
+        return;
+
+    numvisiblesprites = numvisable;
+
     if (!numvisable)
         return; // no visable objects
 
-    for (i = 0; i < numvisable; i++)
-    {
-        least = 32000;
-        for (visstep = &vislist[0]; visstep < visptr; visstep++)
-        {
-            height = visstep->viewheight;
-            if (height < least)
-            {
-                least = height;
-                farthest = visstep;
-            }
-        }
-        //
-        // draw farthest
-        //
-        ScaleShape(farthest->viewx, farthest->shapenum, farthest->viewheight, farthest->flags);
+    SortVisList(numvisable);
 
-        farthest->viewheight = 32000;
-    }
+    for (i = 0; i < numvisable; i++)
+        ScaleShape(vislist[i].viewx, vislist[i].shapenum, vislist[i].viewheight, vislist[i].flags);
 }
 
 //==========================================================================
@@ -1035,12 +1679,11 @@ void CalcTics(void)
     if (lasttimecount > (int32_t)GetTimeCount())
         lasttimecount = GetTimeCount(); // if the game was paused a LONG time
 
-    uint32_t curtime = SDL_GetTicks();
-    tics = (curtime * 7) / 100 - lasttimecount;
+    tics = GetTimeCount() - lasttimecount;
     if (!tics)
     {
         // wait until end of current tic
-        SDL_Delay(((lasttimecount + 1) * 100) / 7 - curtime);
+        TM_WaitForTic(lasttimecount + 1);
         tics = 1;
     }
 
@@ -1052,59 +1695,99 @@ void CalcTics(void)
 
 //==========================================================================
 
-void AsmRefresh()
+typedef struct
 {
+    short xtilestep, ytilestep;
     int32_t xstep, ystep;
+    int32_t xintercept, yintercept; // where the first horizontal and vertical tile lines are crossed
+} raystart_t;
+
+/*
+====================
+=
+= StartRay
+=
+= Direction and first intercepts of the ray through view column x
+=
+====================
+*/
+
+static inline void StartRay(int x, raystart_t *ray)
+{
     longword xpartial, ypartial;
+    short angl = midangle + pixelangle[x];
+
+    if (angl < 0)
+        angl += FINEANGLES;
+    if (angl >= 3600)
+        angl -= FINEANGLES;
+    if (angl < 900)
+    {
+        ray->xtilestep = 1;
+        ray->ytilestep = -1;
+        ray->xstep = finetangent[900 - 1 - angl];
+        ray->ystep = -finetangent[angl];
+        xpartial = xpartialup;
+        ypartial = ypartialdown;
+    }
+    else if (angl < 1800)
+    {
+        ray->xtilestep = -1;
+        ray->ytilestep = -1;
+        ray->xstep = -finetangent[angl - 900];
+        ray->ystep = -finetangent[1800 - 1 - angl];
+        xpartial = xpartialdown;
+        ypartial = ypartialdown;
+    }
+    else if (angl < 2700)
+    {
+        ray->xtilestep = -1;
+        ray->ytilestep = 1;
+        ray->xstep = -finetangent[2700 - 1 - angl];
+        ray->ystep = finetangent[angl - 1800];
+        xpartial = xpartialdown;
+        ypartial = ypartialup;
+    }
+    else
+    {
+        ray->xtilestep = 1;
+        ray->ytilestep = 1;
+        ray->xstep = finetangent[angl - 2700];
+        ray->ystep = finetangent[3600 - 1 - angl];
+        xpartial = xpartialup;
+        ypartial = ypartialup;
+    }
+    ray->yintercept = FixedMul(ray->ystep, xpartial) + viewy;
+    ray->xintercept = FixedMul(ray->xstep, ypartial) + viewx;
+}
+
+/*
+====================
+=
+= AsmRefresh
+=
+= Casts and draws the columns startx up to endx
+=
+====================
+*/
+
+void AsmRefresh(int startx, int endx)
+{
+    int32_t xstep, ystep;
+    raystart_t ray;
     boolean playerInPushwallBackTile = tilemap[focaltx][focalty] == 64;
 
-    for (pixx = 0; pixx < viewwidth; pixx++)
+    for (pixx = startx; pixx < endx; pixx++)
     {
-        short angl = midangle + pixelangle[pixx];
-        if (angl < 0)
-            angl += FINEANGLES;
-        if (angl >= 3600)
-            angl -= FINEANGLES;
-        if (angl < 900)
-        {
-            xtilestep = 1;
-            ytilestep = -1;
-            xstep = finetangent[900 - 1 - angl];
-            ystep = -finetangent[angl];
-            xpartial = xpartialup;
-            ypartial = ypartialdown;
-        }
-        else if (angl < 1800)
-        {
-            xtilestep = -1;
-            ytilestep = -1;
-            xstep = -finetangent[angl - 900];
-            ystep = -finetangent[1800 - 1 - angl];
-            xpartial = xpartialdown;
-            ypartial = ypartialdown;
-        }
-        else if (angl < 2700)
-        {
-            xtilestep = -1;
-            ytilestep = 1;
-            xstep = -finetangent[2700 - 1 - angl];
-            ystep = finetangent[angl - 1800];
-            xpartial = xpartialdown;
-            ypartial = ypartialup;
-        }
-        else if (angl < 3600)
-        {
-            xtilestep = 1;
-            ytilestep = 1;
-            xstep = finetangent[angl - 2700];
-            ystep = finetangent[3600 - 1 - angl];
-            xpartial = xpartialup;
-            ypartial = ypartialup;
-        }
-        yintercept = FixedMul(ystep, xpartial) + viewy;
+        StartRay(pixx, &ray);
+        xtilestep = ray.xtilestep;
+        ytilestep = ray.ytilestep;
+        xstep = ray.xstep;
+        ystep = ray.ystep;
+        yintercept = ray.yintercept;
         xtile = focaltx + xtilestep;
         xspot = (word)((xtile << mapshift) + ((uint32_t)yintercept >> 16));
-        xintercept = FixedMul(xstep, ypartial) + viewx;
+        xintercept = ray.xintercept;
         ytile = focalty + ytilestep;
         yspot = (word)((((uint32_t)xintercept >> 16) << mapshift) + ytile);
         texdelta = 0;
@@ -1304,7 +1987,11 @@ void AsmRefresh()
                 break;
             }
         passvert:
-            *((byte *)spotvis + xspot) = 1;
+            if (!rayspotvis[xspot])
+            {
+                rayspotvis[xspot] = 1;
+                raytiles[numraytiles++] = xspot;
+            }
             xtile += xtilestep;
             yintercept += ystep;
             xspot = (word)((xtile << mapshift) + ((uint32_t)yintercept >> 16));
@@ -1469,7 +2156,11 @@ void AsmRefresh()
                 break;
             }
         passhoriz:
-            *((byte *)spotvis + yspot) = 1;
+            if (!rayspotvis[yspot])
+            {
+                rayspotvis[yspot] = 1;
+                raytiles[numraytiles++] = yspot;
+            }
             ytile += ytilestep;
             xintercept += xstep;
             yspot = (word)((((uint32_t)xintercept >> 16) << mapshift) + ytile);
@@ -1480,80 +2171,809 @@ void AsmRefresh()
 /*
 ====================
 =
-= WallRefresh
+= WallRefreshBand
+=
+= Casts and draws the columns startx up to endx
 =
 ====================
 */
 
-void WallRefresh(void)
+void WallRefreshBand(int startx, int endx)
 {
-    xpartialdown = viewx & (TILEGLOBAL - 1);
-    xpartialup = TILEGLOBAL - xpartialdown;
-    ypartialdown = viewy & (TILEGLOBAL - 1);
-    ypartialup = TILEGLOBAL - ypartialdown;
-
     min_wallheight = viewheight;
-    lastside = -1; // the first pixel is on a new wall
-    AsmRefresh();
-    ScalePost(); // no more optimization on last post
-}
-
-void CalcViewVariables()
-{
-    viewangle = player->angle;
-    // printf("\nvieangle=%d\n",viewangle);
-    midangle = viewangle * (FINEANGLES / ANGLES);
-    viewsin = sintable[viewangle];
-    viewcos = costable[viewangle];
-    // printf("%d\n",viewcos);
-    viewx = player->x - FixedMul(focallength, viewcos);
-    viewy = player->y + FixedMul(focallength, viewsin);
-
-    focaltx = (short)(viewx >> TILESHIFT);
-    focalty = (short)(viewy >> TILESHIFT);
-
-    viewtx = (short)(player->x >> TILESHIFT);
-    viewty = (short)(player->y >> TILESHIFT);
+    raypixels = 0;
+    lastside = -1;    // the first pixel is on a new wall
+    lasttilehit = -1; // and not on a door of the last frame
+    AsmRefresh(startx, endx);
+    if (lastside != -1)
+        ScalePost(); // no more optimization on last post
 }
 
-//==========================================================================
-
 /*
-========================
+====================
 =
-= ThreeDRefresh
+= RenderThread
 =
-========================
+= Waits for a column band to be handed out by WallRefresh and draws it
+=
+====================
 */
 
-void ThreeDRefresh(void)
+static int RenderThread(void *data)
 {
-    //
-    // clear out the traced array
-    //
-    memset(spotvis, 0, maparea);
-    spotvis[player->tilex][player->tiley] = 1; // Detect all sprites over player fix
+    renderband_t *band = (renderband_t *)data;
 
-    vbuf = VL_LockSurface(g_paletteSurface);
-    vbuf += screenofs;
-    vbufPitch = bufferPitch;
+    rayspotvis = &band->spotvis[0][0];
+    raytiles = band->tiles;
+
+    while (1)
+    {
+        SDL_SemWait(band->start);
+        if (renderthreadsquit)
+            break;
+
+        memset(band->spotvis, 0, maparea);
+        numraytiles = 0;
+        WallRefreshBand(band->startx, band->endx);
+        band->minheight = min_wallheight;
+        band->pixels = raypixels;
+        band->numtiles = numraytiles;
+
+        SDL_SemPost(renderbandsdone);
+    }
+
+    return 0;
+}
+
+/*
+====================
+=
+= InitRenderThreads
+=
+= Starts count-1 render threads, the main thread draws the first band itself.
+= A count of 0 uses one thread per CPU.
+=
+====================
+*/
+
+void InitRenderThreads(int count)
+{
+    if (count <= 0)
+        count = SDL_GetCPUCount();
+    if (count > MAXRENDERTHREADS)
+        count = MAXRENDERTHREADS;
+
+    numrenderthreads = 1;
+    if (count == 1)
+        return;
+
+    renderbandsdone = SDL_CreateSemaphore(0);
+    if (!renderbandsdone)
+        Quit("Unable to create render semaphore: %s", SDL_GetError());
+
+    for (int i = 1; i < count; i++)
+    {
+        renderband_t *band = (renderband_t *)malloc(sizeof(renderband_t));
+        CHECKMALLOCRESULT(band);
+        band->start = SDL_CreateSemaphore(0);
+        if (!band->start)
+            Quit("Unable to create render semaphore: %s", SDL_GetError());
+        band->thread = SDL_CreateThread(RenderThread, "RenderThread", band);
+        if (!band->thread)
+        {
+            LOG_Warnf("Unable to create render thread: %s", SDL_GetError());
+            SDL_DestroySemaphore(band->start);
+            free(band);
+            break;
+        }
+        renderbands[numrenderthreads++] = band;
+    }
+
+    LOG_Infof("Wall refresh uses %d render thread(s)", numrenderthreads);
+}
+
+void ShutdownRenderThreads(void)
+{
+    renderthreadsquit = true;
+    for (int i = 1; i < numrenderthreads; i++)
+    {
+        SDL_SemPost(renderbands[i]->start);
+        SDL_WaitThread(renderbands[i]->thread, NULL);
+        SDL_DestroySemaphore(renderbands[i]->start);
+        free(renderbands[i]);
+        renderbands[i] = NULL;
+    }
+    numrenderthreads = 1;
+
+    if (renderbandsdone)
+    {
+        SDL_DestroySemaphore(renderbandsdone);
+        renderbandsdone = NULL;
+    }
+    renderthreadsquit = false;
+}
+
+/*
+====================
+=
+= WallRefresh
+=
+= Splits the view into column bands for the render threads. The band edges
+= are multiples of 4 pixels, so the post merging gives the same result as
+= a single band.
+=
+====================
+*/
+
+void WallRefresh(void)
+{
+    int i, numbands, bandwidth;
+
+    xpartialdown = viewx & (TILEGLOBAL - 1);
+    xpartialup = TILEGLOBAL - xpartialdown;
+    ypartialdown = viewy & (TILEGLOBAL - 1);
+    ypartialup = TILEGLOBAL - ypartialdown;
+
+    rayspotvis = &spotvis[0][0];
+    raytiles = vistiles;
+    numraytiles = numvistiles;
+
+    numbands = viewwidth / MINBANDWIDTH;
+    if (numbands > numrenderthreads)
+        numbands = numrenderthreads;
+
+    if (numbands <= 1)
+    {
+        WallRefreshBand(0, viewwidth);
+        numvistiles = numraytiles;
+        pixelswritten += raypixels;
+        return;
+    }
+
+    bandwidth = ((viewwidth + numbands - 1) / numbands + 3) & ~3;
+
+    for (i = 1; i < numbands; i++)
+    {
+        renderbands[i]->startx = i * bandwidth;
+        renderbands[i]->endx = (i + 1) * bandwidth < viewwidth ? (i + 1) * bandwidth : viewwidth;
+        SDL_SemPost(renderbands[i]->start);
+    }
+
+    WallRefreshBand(0, bandwidth);
+    numvistiles = numraytiles;
+    pixelswritten += raypixels;
+
+    for (i = 1; i < numbands; i++)
+        SDL_SemWait(renderbandsdone);
+
+    //
+    // merge the tiles seen by the render threads
+    //
+    for (i = 1; i < numbands; i++)
+    {
+        word *tiles = renderbands[i]->tiles;
+        byte *dest = &spotvis[0][0];
+        for (int j = 0; j < renderbands[i]->numtiles; j++)
+        {
+            if (!dest[tiles[j]])
+            {
+                dest[tiles[j]] = 1;
+                vistiles[numvistiles++] = tiles[j];
+            }
+        }
+
+        if (renderbands[i]->minheight < min_wallheight)
+            min_wallheight = renderbands[i]->minheight;
+        pixelswritten += renderbands[i]->pixels;
+    }
+}
+
+void CalcViewVariables()
+{
+    viewangle = player->angle;
+    // printf("\nvieangle=%d\n",viewangle);
+    midangle = viewangle * (FINEANGLES / ANGLES);
+    viewsin = sintable[viewangle];
+    viewcos = costable[viewangle];
+    // printf("%d\n",viewcos);
+    viewx = player->x - FixedMul(focallength, viewcos);
+    viewy = player->y + FixedMul(focallength, viewsin);
+
+    focaltx = (short)(viewx >> TILESHIFT);
+    focalty = (short)(viewy >> TILESHIFT);
+
+    viewtx = (short)(player->x >> TILESHIFT);
+    viewty = (short)(player->y >> TILESHIFT);
+}
+
+//==========================================================================
+
+/*
+========================
+=
+= SetupViewColumns
+=
+= (Re)allocates the column-major render target for the current view size
+=
+========================
+*/
+
+static void SetupViewColumns(void)
+{
+    if (viewcolumns && viewcolumnswidth == viewwidth && viewcolumnsheight == viewheight)
+        return;
+
+    free(viewcolumns);
+
+    viewcolumnswidth = viewwidth;
+    viewcolumnsheight = viewheight;
+    viewcolumnspitch = (viewheight + 15) & ~15; // keep the columns 16 byte aligned
+    viewcolumns = (byte *)malloc(viewcolumnspitch * viewwidth);
+    CHECKMALLOCRESULT(viewcolumns);
+}
+
+/*
+========================
+=
+= TransposeViewColumns
+=
+= Copies the column-major view into the screen in 16x16 pixel blocks
+=
+========================
+*/
+
+static inline void Transpose16x16(const byte *src, unsigned srcpitch, byte *dest, unsigned destpitch)
+{
+#ifdef USE_SSE2
+    __m128i a[16], b[16];
+    int i, pass;
+
+    for (i = 0; i < 16; i++)
+        a[i] = _mm_loadu_si128((const __m128i *)(src + i * srcpitch));
+
+    //
+    // four rounds of interleaving the upper and lower half transpose the block
+    //
+    for (pass = 0; pass < 4; pass++)
+    {
+        for (i = 0; i < 8; i++)
+        {
+            b[2 * i] = _mm_unpacklo_epi8(a[i], a[i + 8]);
+            b[2 * i + 1] = _mm_unpackhi_epi8(a[i], a[i + 8]);
+        }
+        for (i = 0; i < 16; i++)
+            a[i] = b[i];
+    }
+
+    for (i = 0; i < 16; i++)
+        _mm_storeu_si128((__m128i *)(dest + i * destpitch), a[i]);
+#else
+    for (int y = 0; y < 16; y++)
+        for (int x = 0; x < 16; x++)
+            dest[y * destpitch + x] = src[x * srcpitch + y];
+#endif
+}
+
+static void TransposeViewColumns(byte *dest, unsigned destpitch)
+{
+    int x, y;
+
+    //
+    // viewwidth is always a multiple of 16, viewheight may not be
+    //
+    for (y = 0; y + 16 <= viewheight; y += 16)
+        for (x = 0; x < viewwidth; x += 16)
+            Transpose16x16(viewcolumns + x * viewcolumnspitch + y, viewcolumnspitch, dest + y * destpitch + x,
+                           destpitch);
+
+    for (; y < viewheight; y++)
+        for (x = 0; x < viewwidth; x++)
+            dest[y * destpitch + x] = viewcolumns[x * viewcolumnspitch + y];
+}
+
+//==========================================================================
+
+/*
+========================
+=
+= UpdateRenderScale
+=
+= Steps renderscale down when the average refresh time of the last frames
+= went over dynrestarget, and up when the larger view is expected to fit
+=
+========================
+*/
+
+static void UpdateRenderScale(void)
+{
+    double ms, nextms;
+
+    if (dynresframes < DYNRESFRAMES)
+        return;
+
+    ms = dynresticks * 1000.0 / SDL_GetPerformanceFrequency() / dynresframes;
+    dynresticks = 0;
+    dynresframes = 0;
+
+    if (ms > dynrestarget)
+    {
+        if (renderscale > RENDERSCALEMIN)
+            SetRenderScale(renderscale - 1);
+    }
+    else if (renderscale < RENDERSCALEFULL)
+    {
+        // the cost grows with the number of pixels
+        nextms = ms * (renderscale + 1) * (renderscale + 1) / (renderscale * renderscale);
+        if (nextms < dynrestarget * DYNRESMARGIN)
+            SetRenderScale(renderscale + 1);
+    }
+}
+
+/*
+========================
+=
+= SetupScaledView
+=
+= Allocates the buffer a view smaller than its screen area is rendered into
+=
+========================
+*/
+
+static void SetupScaledView(void)
+{
+    int size = viewscreenwidth * viewscreenheight;
+
+    if (scaledview && scaledviewsize >= size)
+        return;
+
+    free(scaledview);
+
+    scaledviewsize = size;
+    scaledview = (byte *)malloc(size);
+    CHECKMALLOCRESULT(scaledview);
+}
+
+/*
+========================
+=
+= UpscaleView
+=
+= Stretches the scaled view over the view area of the screen
+=
+========================
+*/
+
+static void UpscaleView(byte *dest, unsigned destpitch)
+{
+    int x, y, srcy, lastsrcy;
+    unsigned srcx, xstep;
+    byte *src;
+
+    xstep = (viewwidth << 16) / viewscreenwidth;
+    lastsrcy = -1;
+
+    for (y = 0; y < viewscreenheight; y++, dest += destpitch)
+    {
+        srcy = y * viewheight / viewscreenheight;
+        if (srcy == lastsrcy)
+        {
+            memcpy(dest, dest - destpitch, viewscreenwidth); // same source row
+            continue;
+        }
+        lastsrcy = srcy;
+
+        src = scaledview + srcy * viewwidth;
+        for (x = 0, srcx = 0; x < viewscreenwidth; x++, srcx += xstep)
+            dest[x] = src[srcx >> 16];
+    }
+}
+
+//==========================================================================
+
+/*
+========================
+=
+= ViewLines
+=
+= The view in vbuf is made of lines (rows, or columns in a column-major
+= view) of linelen pixels, linepitch apart
+=
+========================
+*/
+
+static void ViewLines(int *lines, int *linelen, unsigned *linepitch)
+{
+    if (vbufPitch == 1)
+    {
+        *lines = viewwidth;
+        *linelen = viewheight;
+        *linepitch = vbufStep;
+    }
+    else
+    {
+        *lines = viewheight;
+        *linelen = viewwidth;
+        *linepitch = vbufPitch;
+    }
+}
+
+/*
+========================
+=
+= WallLayerUnchanged
+=
+= True when the wall layer kept by SaveWallLayer shows the current view of
+= the same walls, at the size and layout the view is drawn in now
+=
+========================
+*/
+
+static boolean WallLayerUnchanged(byte ceiling)
+{
+    walllayer_t *layer = &walllayer;
+
+    return layer->valid && layer->viewx == viewx && layer->viewy == viewy && layer->viewangle == viewangle &&
+           layer->worldchanges == worldchanges && layer->width == viewwidth && layer->height == viewheight &&
+           layer->pitch == vbufPitch && layer->step == vbufStep && layer->heightnumerator == heightnumerator &&
+           layer->ceiling == ceiling;
+}
+
+/*
+========================
+=
+= SaveWallLayer
+=
+= Keeps the view as the wall pass left it, before any sprite is drawn
+=
+========================
+*/
+
+static void SaveWallLayer(byte ceiling)
+{
+    walllayer_t *layer = &walllayer;
+    int lines, linelen, i;
+    unsigned linepitch;
+
+    ViewLines(&lines, &linelen, &linepitch);
+
+    if (layer->size < lines * linelen)
+    {
+        free(layer->pixels);
+        layer->size = lines * linelen;
+        layer->pixels = (byte *)malloc(layer->size);
+        CHECKMALLOCRESULT(layer->pixels);
+    }
+    if (!layer->wallheight)
+    {
+        layer->wallheight = (int *)malloc(screenWidth * sizeof(int));
+        CHECKMALLOCRESULT(layer->wallheight);
+    }
+
+    for (i = 0; i < lines; i++)
+        memcpy(layer->pixels + i * linelen, vbuf + i * linepitch, linelen);
+    memcpy(layer->wallheight, wallheight, viewwidth * sizeof(int));
+    memcpy(layer->vistiles, vistiles, numvistiles * sizeof(word));
+    layer->numvistiles = numvistiles;
+    layer->minheight = min_wallheight;
+    layer->pixelswritten = pixelswritten;
+
+    layer->viewx = viewx;
+    layer->viewy = viewy;
+    layer->viewangle = viewangle;
+    layer->worldchanges = worldchanges;
+    layer->width = viewwidth;
+    layer->height = viewheight;
+    layer->pitch = vbufPitch;
+    layer->step = vbufStep;
+    layer->heightnumerator = heightnumerator;
+    layer->ceiling = ceiling;
+    layer->valid = true;
+}
+
+/*
+========================
+=
+= RestoreWallLayer
+=
+= Puts the kept wall layer back into the view, together with the wall
+= heights and the tiles the rays have seen
+=
+========================
+*/
+
+static void RestoreWallLayer(void)
+{
+    walllayer_t *layer = &walllayer;
+    int lines, linelen, i;
+    unsigned linepitch;
+
+    ViewLines(&lines, &linelen, &linepitch);
+
+    for (i = 0; i < lines; i++)
+        memcpy(vbuf + i * linepitch, layer->pixels + i * linelen, linelen);
+    memcpy(wallheight, layer->wallheight, viewwidth * sizeof(int));
+
+    memcpy(vistiles, layer->vistiles, layer->numvistiles * sizeof(word));
+    numvistiles = layer->numvistiles;
+    for (i = 0; i < numvistiles; i++)
+        (&spotvis[0][0])[vistiles[i]] = 1;
+
+    min_wallheight = layer->minheight;
+    pixelswritten = lines * linelen;
+}
+
+//==========================================================================
+
+/*
+========================
+=
+= UpdateVisibility
+=
+= Traces the view of the current tic without drawing it, so spotvis,
+= bonus pickups and the actors' FL_VISABLE, active and viewx are updated
+= exactly as a ThreeDRefresh would.  The interpolated frames drawn
+= afterwards only show the view and leave the game state alone.
+=
+========================
+*/
+
+void UpdateVisibility(void)
+{
+    memset(spotvis, 0, maparea);
+    spotvis[player->tilex][player->tiley] = 1; // Detect all sprites over player fix
+    vistiles[0] = (player->tilex << mapshift) + player->tiley;
+    numvistiles = 1;
+
+    CalcViewVariables();
+
+    visibilityonly = true;
+    WallRefresh();
+    DrawScaleds();
+    visibilityonly = false;
+}
+
+//==========================================================================
+
+/*
+========================
+=
+= BenchmarkRays
+=
+= Turns the player around on the spot of the current level. Every frame is
+= drawn by each ray caster, which all have to give the same view and
+= wallheight as the one dividing for the heights, then each caster is timed
+= on its own. Quits with an error when a frame differs
+=
+========================
+*/
+
+#define RAYBENCHSTEP 2 // angles turned between two frames
+
+typedef struct
+{
+    const char *name;
+    boolean table;
+} raycaster_t;
+
+static const raycaster_t raycasters[] = {
+    {"division", false},
+    {"height table", true},
+};
+
+#define NUMRAYCASTERS (int)(sizeof(raycasters) / sizeof(raycasters[0]))
+
+static void DrawRayFrame(byte *buffer, int angle)
+{
+    memset(spotvis, 0, maparea);
+    spotvis[player->tilex][player->tiley] = 1;
+    vistiles[0] = (player->tilex << mapshift) + player->tiley;
+    numvistiles = 1;
+
+    player->angle = angle;
+    CalcViewVariables();
+
+    vbuf = buffer;
+    vbufPitch = viewwidth;
+    vbufStep = 1;
+    pixelswritten = 0;
+
+    VGAClearScreen();
+    WallRefresh();
+}
+
+void BenchmarkRays(int iterations)
+{
+    int c, iter, angle, numframes, totalmismatches;
+    int mismatches[NUMRAYCASTERS];
+    byte *buffers[2];
+    int *heights;
+    Uint64 ticks[NUMRAYCASTERS];
+    boolean oldheighttables = heighttables;
+    short oldangle = player->angle;
+
+    for (c = 0; c < 2; c++)
+    {
+        buffers[c] = (byte *)malloc(viewwidth * viewheight);
+        CHECKMALLOCRESULT(buffers[c]);
+    }
+    heights = (int *)malloc(viewwidth * sizeof(int));
+    CHECKMALLOCRESULT(heights);
+
+    //
+    // golden frames: the view and wallheight of the first caster
+    //
+    memset(mismatches, 0, sizeof(mismatches));
+    for (angle = 0, numframes = 0; angle < ANGLES; angle += RAYBENCHSTEP, numframes++)
+    {
+        heighttables = raycasters[0].table;
+        DrawRayFrame(buffers[0], angle);
+        memcpy(heights, wallheight, viewwidth * sizeof(int));
+
+        for (c = 1; c < NUMRAYCASTERS; c++)
+        {
+            heighttables = raycasters[c].table;
+            DrawRayFrame(buffers[1], angle);
+
+            if (memcmp(buffers[0], buffers[1], viewwidth * viewheight) ||
+                memcmp(heights, wallheight, viewwidth * sizeof(int)))
+            {
+                if (!mismatches[c])
+                    LOG_Warnf("ray benchmark: %s differ at angle %d", raycasters[c].name, angle);
+                mismatches[c]++;
+            }
+        }
+    }
+
+    for (c = 0; c < NUMRAYCASTERS; c++)
+    {
+        heighttables = raycasters[c].table;
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (iter = 0; iter < iterations; iter++)
+            for (angle = 0; angle < ANGLES; angle += RAYBENCHSTEP)
+                DrawRayFrame(buffers[0], angle);
+        ticks[c] = SDL_GetPerformanceCounter() - start;
+    }
+
+    vbuf = NULL;
+    heighttables = oldheighttables;
+    player->angle = oldangle;
+
+    double msperticks = 1000.0 / SDL_GetPerformanceFrequency();
+    LOG_Infof("ray benchmark: %d frames x %d iterations at %dx%d", numframes, iterations, viewwidth, viewheight);
+    totalmismatches = 0;
+    for (c = 0; c < NUMRAYCASTERS; c++)
+    {
+        LOG_Infof("%s: %.3f ms per frame (%d of %d frames differ)", raycasters[c].name,
+                  ticks[c] * msperticks / (iterations * numframes), mismatches[c], numframes);
+        totalmismatches += mismatches[c];
+    }
+
+    free(buffers[0]);
+    free(buffers[1]);
+    free(heights);
+
+    if (totalmismatches)
+        Quit("The ray casters differ from the one dividing for the heights in %d frames!", totalmismatches);
+}
+
+//==========================================================================
+
+/*
+========================
+=
+= ThreeDRefresh
+=
+========================
+*/
+
+void ThreeDRefresh(void)
+{
+    Uint64 refreshstart;
+
+    TraceBegin("ThreeDRefresh");
+
+    if (dynamicres)
+        UpdateRenderScale();
+
+    refreshstart = SDL_GetPerformanceCounter();
+
+    //
+    // clear out the traced array
+    //
+    memset(spotvis, 0, maparea);
+    spotvis[player->tilex][player->tiley] = 1; // Detect all sprites over player fix
+    vistiles[0] = (player->tilex << mapshift) + player->tiley;
+    numvistiles = 1;
+
+    byte *screenbuf = VL_LockSurface(g_paletteSurface) + screenofs;
+
+    //
+    // a view rendered smaller than it is shown goes through scaledview
+    //
+    byte *viewbuf = screenbuf;
+    unsigned viewbufpitch = bufferPitch;
+
+    if (renderscale != RENDERSCALEFULL || detailshift)
+    {
+        SetupScaledView();
+        viewbuf = scaledview;
+        viewbufpitch = viewwidth;
+    }
+
+    if (columnmajorview)
+    {
+        SetupViewColumns();
+        vbuf = viewcolumns;
+        vbufPitch = 1;
+        vbufStep = viewcolumnspitch;
+    }
+    else
+    {
+        vbuf = viewbuf;
+        vbufPitch = viewbufpitch;
+        vbufStep = 1;
+    }
 
     CalcViewVariables();
 
     //
     // follow the walls from there to the right, drawing as we go
     //
-    VGAClearScreen();
+    pixelswritten = 0;
+    countpixels = timedemo || fpscounter;
 
-    WallRefresh();
+    byte ceiling = vgaCeiling[gamestate.episode * 10 + mapon];
+
+    if (framereuse && WallLayerUnchanged(ceiling))
+    {
+        ProfileBegin(prof_walls);
+        RestoreWallLayer();
+        ProfileEnd();
+        reusedframes++;
+    }
+    else
+    {
+        if (fusedfill)
+            fillceiling = ceiling;
+        else
+        {
+            ProfileBegin(prof_clear);
+            VGAClearScreen();
+            ProfileEnd();
+        }
+
+        ProfileBegin(prof_walls);
+        WallRefresh();
+        ProfileEnd();
+
+        if (framereuse)
+            SaveWallLayer(ceiling);
+    }
 
     //
     // draw all the scaled images
     //
 
+    ProfileBegin(prof_scaleds);
     DrawScaleds(); // draw scaled stuff
+    ProfileEnd();
 
+    ProfileBegin(prof_weapon);
     DrawPlayerWeapon(); // draw player's hands
+    ProfileEnd();
+
+    if (columnmajorview)
+        TransposeViewColumns(viewbuf, viewbufpitch);
+
+    if (viewbuf != screenbuf)
+        UpscaleView(screenbuf, bufferPitch);
+
+    if (dynamicres)
+    {
+        dynresticks += SDL_GetPerformanceCounter() - refreshstart;
+        dynresframes++;
+    }
 
     if (Keyboard[sc_Tab] && viewsize == 21 && gamestate.weapon != -1)
         ShowActStatus();
@@ -1581,13 +3001,35 @@ void ThreeDRefresh(void)
             SETFONTCOLOR(7, 127);
             PrintX = 4;
             PrintY = 1;
-            VWB_Bar(0, 0, 50, 10, bordercol);
+            VWB_Bar(0, 0, 50, dynamicres ? 40 : 30, bordercol);
             US_PrintSigned(fps);
             US_Print(" fps");
+            PrintX = 4;
+            PrintY = 11;
+            US_PrintSigned(numvisiblesprites);
+            US_Print(" spr");
+            PrintX = 4;
+            PrintY = 21;
+            US_PrintSigned((pixelswritten + 500) / 1000);
+            US_Print("k px");
+            if (dynamicres)
+            {
+                PrintX = 4;
+                PrintY = 31;
+                US_PrintSigned(renderscale * 100 / RENDERSCALEFULL);
+                US_Print("%");
+            }
         }
+        if (profoverlay)
+            DrawProfileOverlay();
 #endif
+        ProfileBegin(prof_blit);
         SDL_VL_BlitIndexedSurfaceToScreen();
+        ProfileEnd();
+
+        ProfileBegin(prof_present);
         SDL_VL_Present();
+        ProfileEnd();
     }
 
 #ifndef REMDEBUG
@@ -1604,4 +3046,6 @@ void ThreeDRefresh(void)
         }
     }
 #endif
+
+    TraceEnd();
 }
@@ -27,6 +27,7 @@
 */
 
 boolean ingame, fizzlein;
+boolean timedemo;
 gametype gamestate;
 byte bordercol = VIEWCOLOR; // color of the Change View/Ingame border
 
@@ -54,6 +55,11 @@ void GameLoop(void);
 =============================================================================
 */
 
+static Uint64 *timedemoframes;
+static int numtimedemoframes, maxtimedemoframes;
+static int timedemosprites, timedemomaxsprites;
+static Uint64 timedemopixels;
+
 //===========================================================================
 //===========================================================================
 
@@ -607,6 +613,8 @@ void SetupGameLevel(void)
     word *map;
     word tile;
 
+    TraceBegin("SetupGameLevel");
+
     if (!loadedgame)
     {
         gamestate.TimeCount = gamestate.secrettotal = gamestate.killtotal = gamestate.treasuretotal =
@@ -627,6 +635,12 @@ void SetupGameLevel(void)
     CA_CacheMap(gamestate.mapon + 10 * gamestate.episode);
     mapon -= gamestate.episode * 10;
 
+    //
+    // keep the fade out of the intermission going between the stages, if
+    // there is one
+    //
+    VL_UpdateFade(true);
+
     //
     // copy the wall data to a data segment array
     //
@@ -696,6 +710,7 @@ void SetupGameLevel(void)
     // spawn actors
     //
     ScanInfoPlane();
+    VL_UpdateFade(true);
 
     //
     // take out the ambush markers
@@ -725,12 +740,16 @@ void SetupGameLevel(void)
             }
         }
     }
+    MarkWorldChanged();
+    VL_UpdateFade(true);
 
     //
     // have the caching manager load and purge stuff to make sure all marks
     // are in memory
     //
     CA_LoadAllSounds();
+
+    TraceEnd();
 }
 
 //==========================================================================
@@ -751,8 +770,8 @@ void DrawPlayBorderSides(void)
 
     const int sw = screenWidth;
     const int sh = screenHeight;
-    const int vw = viewwidth;
-    const int vh = viewheight;
+    const int vw = viewscreenwidth;
+    const int vh = viewscreenheight;
     const int px = scaleFactor; // size of one "pixel"
 
     const int h = sh - px * STATUSLINES;
@@ -846,33 +865,33 @@ void DrawPlayBorder(void)
                            statusborderw + px * 8, px * STATUSLINES, bordercol);
     }
 
-    if ((unsigned)viewheight == screenHeight)
+    if ((unsigned)viewscreenheight == screenHeight)
         return;
 
     VWB_BarScaledCoord(0, 0, screenWidth, screenHeight - px * STATUSLINES, bordercol);
 
-    const int xl = screenWidth / 2 - viewwidth / 2;
-    const int yl = (screenHeight - px * STATUSLINES - viewheight) / 2;
-    VWB_BarScaledCoord(xl, yl, viewwidth, viewheight, 0);
+    const int xl = screenWidth / 2 - viewscreenwidth / 2;
+    const int yl = (screenHeight - px * STATUSLINES - viewscreenheight) / 2;
+    VWB_BarScaledCoord(xl, yl, viewscreenwidth, viewscreenheight, 0);
 
     if (xl != 0)
     {
         // Paint game view border lines
-        VWB_BarScaledCoord(xl - px, yl - px, viewwidth + px, px,
+        VWB_BarScaledCoord(xl - px, yl - px, viewscreenwidth + px, px,
                            0); // upper border
-        VWB_BarScaledCoord(xl, yl + viewheight, viewwidth + px, px,
+        VWB_BarScaledCoord(xl, yl + viewscreenheight, viewscreenwidth + px, px,
                            bordercol - 2); // lower border
-        VWB_BarScaledCoord(xl - px, yl - px, px, viewheight + px,
+        VWB_BarScaledCoord(xl - px, yl - px, px, viewscreenheight + px,
                            0); // left border
-        VWB_BarScaledCoord(xl + viewwidth, yl - px, px, viewheight + 2 * px,
+        VWB_BarScaledCoord(xl + viewscreenwidth, yl - px, px, viewscreenheight + 2 * px,
                            bordercol - 2); // right border
-        VWB_BarScaledCoord(xl - px, yl + viewheight, px, px,
+        VWB_BarScaledCoord(xl - px, yl + viewscreenheight, px, px,
                            bordercol - 3); // lower left highlight
     }
     else
     {
         // Just paint a lower border line
-        VWB_BarScaledCoord(0, yl + viewheight, viewwidth, px,
+        VWB_BarScaledCoord(0, yl + viewscreenheight, viewscreenwidth, px,
                            bordercol - 2); // lower border
     }
 }
@@ -1178,6 +1197,92 @@ void PlayDemo(int demonumber)
 
 //==========================================================================
 
+/*
+==================
+=
+= TimeDemoFrame
+=
+= Records the performance counter ticks spent on one PlayLoop frame
+=
+==================
+*/
+
+void TimeDemoFrame(Uint64 frameticks)
+{
+    if (numtimedemoframes == maxtimedemoframes)
+    {
+        maxtimedemoframes = maxtimedemoframes ? maxtimedemoframes * 2 : 4096;
+        timedemoframes = (Uint64 *)realloc(timedemoframes, maxtimedemoframes * sizeof(Uint64));
+        CHECKMALLOCRESULT(timedemoframes);
+    }
+    timedemoframes[numtimedemoframes++] = frameticks;
+
+    timedemosprites += numvisiblesprites;
+    if (numvisiblesprites > timedemomaxsprites)
+        timedemomaxsprites = numvisiblesprites;
+    timedemopixels += pixelswritten;
+}
+
+static int CompareFrameTicks(const void *a, const void *b)
+{
+    Uint64 x = *(const Uint64 *)a;
+    Uint64 y = *(const Uint64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+==================
+=
+= TimeDemo
+=
+= Plays a demo as fast as possible and reports the frame times
+=
+==================
+*/
+
+void TimeDemo(int demonumber)
+{
+    numtimedemoframes = 0;
+    timedemosprites = timedemomaxsprites = 0;
+    timedemopixels = 0;
+    reusedframes = 0;
+    timedemo = true;
+    PlayDemo(demonumber);
+    timedemo = false;
+
+    if (!numtimedemoframes)
+    {
+        LOG_Warnf("timedemo %d: no frames were rendered", demonumber);
+        return;
+    }
+
+    Uint64 total = 0;
+    for (int i = 0; i < numtimedemoframes; i++)
+        total += timedemoframes[i];
+
+    qsort(timedemoframes, numtimedemoframes, sizeof(Uint64), CompareFrameTicks);
+
+    double msperticks = 1000.0 / SDL_GetPerformanceFrequency();
+    int last = numtimedemoframes - 1;
+
+    LOG_Infof("timedemo %d: %d frames in %.3f s, %.2f fps average", demonumber, numtimedemoframes,
+              total * msperticks / 1000.0, numtimedemoframes * 1000.0 / (total * msperticks));
+    LOG_Infof("frame times (ms): p50 %.3f, p95 %.3f, p99 %.3f, max %.3f", timedemoframes[last * 50 / 100] * msperticks,
+              timedemoframes[last * 95 / 100] * msperticks, timedemoframes[last * 99 / 100] * msperticks,
+              timedemoframes[last] * msperticks);
+    LOG_Infof("visible sprites: %.1f average, %d max", (double)timedemosprites / numtimedemoframes,
+              timedemomaxsprites);
+    LOG_Infof("view pixels written: %.0f per frame", (double)timedemopixels / numtimedemoframes);
+    if (framereuse)
+        LOG_Infof("wall layer reused: %d of %d frames", reusedframes, numtimedemoframes);
+
+    free(timedemoframes);
+    timedemoframes = NULL;
+    maxtimedemoframes = 0;
+}
+
+//==========================================================================
+
 /*
 ==================
 =
@@ -1290,11 +1395,11 @@ void Died(void)
     if (usedoublebuffering)
         VH_UpdateScreen();
 
-    VL_BarScaledCoord(viewscreenx, viewscreeny, viewwidth, viewheight, 4);
+    VL_BarScaledCoord(viewscreenx, viewscreeny, viewscreenwidth, viewscreenheight, 4);
 
     IN_ClearKeysDown();
 
-    FizzleFade(g_paletteSurface, viewscreenx, viewscreeny, viewwidth, viewheight, 70, false);
+    FizzleFade(g_paletteSurface, viewscreenx, viewscreeny, viewscreenwidth, viewscreenheight, 70, false);
 
     IN_UserInput(100);
     SD_WaitSoundDone();
@@ -1309,6 +1414,7 @@ void Died(void)
         gamestate.ammo = STARTAMMO;
         gamestate.keys = 0;
         pwallstate = pwallpos = 0;
+        MarkWorldChanged();
         gamestate.attackframe = gamestate.attackcount = gamestate.weaponframe = 0;
 
         if (viewsize != 21)
@@ -1335,7 +1441,7 @@ void Died(void)
 
 void GameLoop(void)
 {
-    boolean died;
+    boolean died, intermission = false;
 #ifdef MYPROFILE
     clock_t start, end;
 #endif
@@ -1350,12 +1456,22 @@ restartgame:
     {
         if (!loadedgame)
             gamestate.score = gamestate.oldscore;
-        if (!died || viewsize != 21)
-            DrawScore();
 
         startgame = false;
         if (!loadedgame)
-            SetupGameLevel();
+            SetupGameLevel(); // while the intermission fades out
+
+        if (intermission)
+        {
+            VL_FinishFade();
+            DrawPlayBorder();
+            if (viewsize == 21)
+                DrawPlayScreen();
+            intermission = false;
+        }
+
+        if (!died || viewsize != 21)
+            DrawScore();
 
 #ifdef SPEAR
         if (gamestate.mapon == 20) // give them the key allways
@@ -1437,8 +1553,7 @@ restartgame:
             ClearMemory();
 
             LevelCompleted(); // do the intermission
-            if (viewsize == 21)
-                DrawPlayScreen();
+            intermission = true;
 
 #ifdef SPEARDEMO
             if (gamestate.mapon == 1)
@@ -389,7 +389,7 @@ void BJ_Breathe(void)
     static int which = 0, max = 10;
     int pics[2] = {L_GUYPIC, L_GUY2PIC};
 
-    SDL_Delay(5);
+    TM_WaitNextTic();
 
     if ((int32_t)GetTimeCount() - lastBreathTime > max)
     {
@@ -409,7 +409,8 @@ void BJ_Breathe(void)
 = Entered with the screen faded out
 = Still in split screen mode with the status bar
 =
-= Exit with the screen faded out
+= Exits with the screen fading out, GameLoop finishes the fade once it has
+= set up the next level
 =
 ==================
 */
@@ -913,8 +914,7 @@ void LevelCompleted(void)
     }
 #endif
 
-    VW_FadeOut();
-    DrawPlayBorder();
+    VL_StartFadeOut(0, 255, 0, 0, 0, 30);
 
     UnCacheLump(LEVELEND_LUMP_START, LEVELEND_LUMP_END);
 }
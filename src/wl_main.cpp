@@ -57,8 +57,12 @@ int dirangle[9] = {
 fixed focallength;
 unsigned screenofs;
 int viewscreenx, viewscreeny;
-int viewwidth;
+int viewscreenwidth, viewscreenheight; // size of the view on the screen
+int viewwidth;                         // size the view is rendered at
 int viewheight;
+int renderscale = RENDERSCALEFULL; // viewwidth = viewscreenwidth * renderscale / RENDERSCALEFULL
+int detailshift;                   // and only 1 / (1 << detailshift) of that wide
+fixed detailxscale;                // rendered columns per shown column of a low detail view
 short centerx;
 int shootdelta; // pixels away from centerx a target can be
 fixed scale;
@@ -89,6 +93,14 @@ int param_audiobuffer = 2048 / (44100 / param_samplerate);
 int param_mission = 0;
 boolean param_goodtimes = false;
 boolean param_ignorenumchunks = false;
+int param_timedemo = -1;     // default is not to time a demo
+int param_renderthreads = 0; // default is one per CPU
+int param_detail = -1;       // -1 keeps the detail of the config
+boolean param_blitbench = false;
+boolean param_spritebench = false;
+boolean param_raybench = false;
+const char *param_profilecsv = NULL;
+const char *param_trace = NULL;
 
 /*
 =============================================================================
@@ -154,6 +166,8 @@ void ReadConfig(void)
 
         read(file, &viewsize, sizeof(viewsize));
         read(file, &mouseadjustment, sizeof(mouseadjustment));
+        detailshift = 0;
+        read(file, &detailshift, sizeof(detailshift)); // missing in older configs
 
         close(file);
 
@@ -188,6 +202,9 @@ void ReadConfig(void)
         else if (viewsize > 21)
             viewsize = 21;
 
+        if (detailshift < 0 || detailshift > MAXDETAILSHIFT)
+            detailshift = 0;
+
         MainMenu[6].active = 1;
         MainItems.curpos = 0;
     }
@@ -221,8 +238,12 @@ void ReadConfig(void)
 
         viewsize = 19; // start with a good size
         mouseadjustment = 5;
+        detailshift = 0;
     }
 
+    if (param_detail != -1)
+        detailshift = param_detail;
+
     SD_SetMusicMode(sm);
     SD_SetSoundMode(sd);
     SD_SetDigiDevice(sds);
@@ -272,6 +293,7 @@ void WriteConfig(void)
 
         write(file, &viewsize, sizeof(viewsize));
         write(file, &mouseadjustment, sizeof(mouseadjustment));
+        write(file, &detailshift, sizeof(detailshift));
 
         close(file);
     }
@@ -561,6 +583,7 @@ boolean LoadTheGame(FILE *file, int x, int y)
         nullstat.visspot = (byte *)((uintptr_t)nullstat.visspot + (uintptr_t)spotvis);
         memcpy(statobjlist + i, &nullstat, sizeof(nullstat));
     }
+    BuildStaticIndex();
 
     DiskFlopAnim(x, y);
     fread(doorposition, sizeof(doorposition), 1, file);
@@ -612,6 +635,7 @@ boolean LoadTheGame(FILE *file, int x, int y)
     }
 
     Thrust(0, 0); // set player->areanumber to the floortile you're standing on
+    MarkWorldChanged();
 
     fread(&oldchecksum, sizeof(oldchecksum), 1, file);
 
@@ -650,11 +674,14 @@ boolean LoadTheGame(FILE *file, int x, int y)
 void ShutdownId(void)
 {
     US_Shutdown(); // This line is completely useless...
+    ShutdownRenderThreads();
+    ProfileShutdown();
     SD_Shutdown();
     PM_Shutdown();
     IN_Shutdown();
     VW_Shutdown();
     CA_Shutdown();
+    TraceShutdown();
 }
 
 //===========================================================================
@@ -724,7 +751,7 @@ void CalcProjection(int32_t focal)
     int intang;
     float angle;
     double tang;
-    int halfview;
+    int halfview, heighthalfview;
     double facedist;
 
     focallength = focal;
@@ -740,8 +767,21 @@ void CalcProjection(int32_t focal)
     //
     // divide heightnumerator by a posts distance to get the posts height for
     // the heightbuffer.  The pixel height is height>>2
+    // A low detail view takes its heights from the width UpscaleView stretches
+    // it to, counted in rendered rows, so it keeps its aspect however viewwidth
+    // was rounded. Sprites are narrowed by detailxscale to match
     //
-    heightnumerator = (TILEGLOBAL * scale) >> 6;
+    if (detailshift)
+    {
+        heighthalfview = viewscreenwidth * viewheight / viewscreenheight / 2;
+        detailxscale = (fixed)(((int64_t)halfview << 16) / heighthalfview);
+    }
+    else
+    {
+        heighthalfview = halfview;
+        detailxscale = 1 << 16;
+    }
+    heightnumerator = (TILEGLOBAL * (fixed)(heighthalfview * facedist / (VIEWGLOBAL / 2))) >> 6;
 
     //
     // calculate the angle offset from view angle of each pixel's ray
@@ -756,6 +796,13 @@ void CalcProjection(int32_t focal)
         pixelangle[halfview - 1 - i] = intang;
         pixelangle[halfview + i] = -intang;
     }
+
+    //
+    // the height table and the scalers depend on heightnumerator and the
+    // view height
+    //
+    SetupHeightTable();
+    SetupScalers();
 }
 
 //===========================================================================
@@ -1087,6 +1134,10 @@ static void InitGame()
     boolean didjukebox = false;
 #endif
 
+    // without a window there is no need for a real display
+    if (offscreen)
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+
     // initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER) < 0)
     {
@@ -1095,6 +1146,13 @@ static void InitGame()
     }
     atexit(SDL_Quit);
 
+    TM_Startup();
+
+    if (param_profilecsv)
+        ProfileOpenCSV(param_profilecsv);
+    if (param_trace)
+        TraceOpen(param_trace);
+
     SDL_version version;
     SDL_VERSION(&version);
     LOG_Infof("SDL version %d.%d.%d initialized", version.major, version.minor, version.patch);
@@ -1114,6 +1172,7 @@ static void InitGame()
     VH_Startup();
     IN_Startup();
     PM_Startup();
+    SetupSpriteSpans();
     SD_Startup();
     CA_Startup();
     US_Startup();
@@ -1173,6 +1232,7 @@ static void InitGame()
     LoadLatchMem();
     BuildTables(); // trig tables
     SetupWalls();
+    InitRenderThreads(param_renderthreads);
 
     NewViewSize(viewsize);
 
@@ -1203,55 +1263,78 @@ static void InitGame()
 
 boolean SetViewSize(unsigned width, unsigned height)
 {
-    viewwidth = width & ~15;  // must be divisable by 16
-    viewheight = height & ~1; // must be even
-    centerx = viewwidth / 2 - 1;
-    shootdelta = viewwidth / 10;
-    if ((unsigned)viewheight == screenHeight)
+    viewscreenwidth = width & ~15;  // must be divisable by 16
+    viewscreenheight = height & ~1; // must be even
+    if ((unsigned)viewscreenheight == screenHeight)
         viewscreenx = viewscreeny = screenofs = 0;
     else
     {
-        viewscreenx = (screenWidth - viewwidth) / 2;
-        viewscreeny = (screenHeight - scaleFactor * STATUSLINES - viewheight) / 2;
+        viewscreenx = (screenWidth - viewscreenwidth) / 2;
+        viewscreeny = (screenHeight - scaleFactor * STATUSLINES - viewscreenheight) / 2;
         screenofs = viewscreeny * screenWidth + viewscreenx;
     }
 
+    SetRenderScale(renderscale);
+
+    return true;
+}
+
+/*
+==========================
+=
+= SetRenderScale
+=
+= Sets the size the 3D view is rendered at, in RENDERSCALEFULL parts of
+= the view size on the screen. A low detail view is narrower still
+=
+==========================
+*/
+
+void SetRenderScale(int newscale)
+{
+    renderscale = newscale;
+    // a low detail view is rounded to whole groups of 1 << detailshift columns
+    viewwidth = ((viewscreenwidth * renderscale / RENDERSCALEFULL) & ~((16 << detailshift) - 1)) >> detailshift;
+    if (viewwidth < 16)
+        viewwidth = 16;
+    viewheight = (viewscreenheight * renderscale / RENDERSCALEFULL) & ~1;
+    centerx = viewwidth / 2 - 1;
+    shootdelta = viewwidth / 10;
+
     //
     // calculate trace angles and projection constants
     //
     CalcProjection(FOCALLENGTH);
-
-    return true;
 }
 
 void ShowViewSize(int width)
 {
     int oldwidth, oldheight;
 
-    oldwidth = viewwidth;
-    oldheight = viewheight;
+    oldwidth = viewscreenwidth;
+    oldheight = viewscreenheight;
 
     if (width == 21)
     {
-        viewwidth = screenWidth;
-        viewheight = screenHeight;
+        viewscreenwidth = screenWidth;
+        viewscreenheight = screenHeight;
         VWB_BarScaledCoord(0, 0, screenWidth, screenHeight, 0);
     }
     else if (width == 20)
     {
-        viewwidth = screenWidth;
-        viewheight = screenHeight - scaleFactor * STATUSLINES;
+        viewscreenwidth = screenWidth;
+        viewscreenheight = screenHeight - scaleFactor * STATUSLINES;
         DrawPlayBorder();
     }
     else
     {
-        viewwidth = width * 16 * screenWidth / 320;
-        viewheight = (int)(width * 16 * HEIGHTRATIO * screenHeight / 200);
+        viewscreenwidth = width * 16 * screenWidth / 320;
+        viewscreenheight = (int)(width * 16 * HEIGHTRATIO * screenHeight / 200);
         DrawPlayBorder();
     }
 
-    viewwidth = oldwidth;
-    viewheight = oldheight;
+    viewscreenwidth = oldwidth;
+    viewscreenheight = oldheight;
 }
 
 void NewViewSize(int width)
@@ -1389,6 +1472,45 @@ static void DemoLoop()
         Quit(NULL);
     }
 
+    //
+    // benchmark the palette conversion and exit
+    //
+    if (param_blitbench)
+    {
+        SDL_VL_BenchmarkConversion(200);
+        Quit(NULL);
+    }
+
+    //
+    // benchmark the sprite drawing and exit
+    //
+    if (param_spritebench)
+    {
+        BenchmarkSprites(200);
+        Quit(NULL);
+    }
+
+    //
+    // compare the height table with the ray caster dividing for the
+    // heights on the first level and exit
+    //
+    if (param_raybench)
+    {
+        NewGame(param_difficulty, 0);
+        SetupGameLevel();
+        BenchmarkRays(10);
+        Quit(NULL);
+    }
+
+    //
+    // benchmark a demo and exit
+    //
+    if (param_timedemo != -1)
+    {
+        TimeDemo(param_timedemo);
+        Quit(NULL);
+    }
+
     //
     // main game cycle
     //
@@ -1551,6 +1673,138 @@ void CheckParameters(int argc, char *argv[])
             else
                 param_tedlevel = atoi(argv[i]);
         }
+        else IFARG("--timedemo")
+        {
+            if (++i >= argc)
+            {
+                LOG_Errorf("The timedemo option is missing the demo argument!");
+                hasError = true;
+            }
+            else
+            {
+                param_timedemo = atoi(argv[i]);
+#ifndef SPEARDEMO
+                if (param_timedemo < 0 || param_timedemo > 3)
+                {
+                    LOG_Errorf("The timedemo option must be between 0 and 3!");
+                    hasError = true;
+                }
+#else
+                if (param_timedemo != 0)
+                {
+                    LOG_Errorf("The timedemo option must be 0!");
+                    hasError = true;
+                }
+#endif
+                param_nowait = true;
+                usevsync = false;
+            }
+        }
+        else IFARG("--resolution")
+        {
+            unsigned width, height;
+            if (++i >= argc)
+            {
+                LOG_Errorf("The resolution option is missing the WxH argument!");
+                hasError = true;
+            }
+            else if (sscanf(argv[i], "%ux%u", &width, &height) != 2)
+            {
+                LOG_Errorf("The resolution option must be given as WxH, e.g. 960x600!");
+                hasError = true;
+            }
+            else
+            {
+                unsigned factor = width / 320;
+                if (!factor || width % 320 || (height != 200 * factor && height != 240 * factor))
+                {
+                    LOG_Errorf("Screen size must be a multiple of 320x200 or 320x240!");
+                    hasError = true;
+                }
+                else
+                {
+                    screenWidth = width;
+                    screenHeight = height;
+                }
+            }
+        }
+        else IFARG("--dynamicres")
+        {
+            if (++i >= argc)
+            {
+                LOG_Errorf("The dynamicres option is missing the milliseconds argument!");
+                hasError = true;
+            }
+            else
+            {
+                dynrestarget = atof(argv[i]);
+                if (dynrestarget <= 0)
+                {
+                    LOG_Errorf("The dynamicres option needs a positive frame time!");
+                    hasError = true;
+                }
+                dynamicres = true;
+            }
+        }
+        else IFARG("--detail")
+        {
+            if (++i >= argc)
+            {
+                LOG_Errorf("The detail option is missing the level argument!");
+                hasError = true;
+            }
+            else
+            {
+                param_detail = atoi(argv[i]);
+                if (param_detail < 0 || param_detail > MAXDETAILSHIFT)
+                {
+                    LOG_Errorf("The detail level must be between 0 and %d!", MAXDETAILSHIFT);
+                    hasError = true;
+                }
+            }
+        }
+        else IFARG("--offscreen") offscreen = true;
+        else IFARG("--blitbench") param_blitbench = true;
+        else IFARG("--spritebench") param_spritebench = true;
+        else IFARG("--copypresent") zerocopypresent = false;
+        else IFARG("--uncapped") uncapped = true;
+        else IFARG("--noscalertables") scalertables = false;
+        else IFARG("--noheighttable") heighttables = false;
+        else IFARG("--nospritespans") spritespans = false;
+        else IFARG("--columnmajor") columnmajorview = true;
+        else IFARG("--fusedfill") fusedfill = true;
+        else IFARG("--framereuse") framereuse = true;
+        else IFARG("--raybench") param_raybench = true;
+        else IFARG("--renderthreads")
+        {
+            if (++i >= argc)
+            {
+                LOG_Errorf("The renderthreads option is missing the count argument!");
+                hasError = true;
+            }
+            else
+                param_renderthreads = atoi(argv[i]);
+        }
+        else IFARG("--profilecsv")
+        {
+            if (++i >= argc)
+            {
+                LOG_Errorf("The profilecsv option is missing the file argument!");
+                hasError = true;
+            }
+            else
+                param_profilecsv = argv[i];
+        }
+        else IFARG("--trace")
+        {
+            if (++i >= argc)
+            {
+                LOG_Errorf("The trace option is missing the file argument!");
+                hasError = true;
+            }
+            else
+                param_trace = argv[i];
+        }
         else IFARG("--windowed") fullscreen = false;
         else IFARG("--windowed-mouse")
         {
@@ -1663,6 +1917,46 @@ void CheckParameters(int argc, char *argv[])
                "tedlevel\n"
                " --hard                 Sets the difficulty to hard for tedlevel\n"
                " --nowait               Skips intro screens\n"
+               " --resolution <WxH>     Renders the game at the given size, a multiple\n"
+               "                        of 320x200 or 320x240 (default: 640x400)\n"
+               " --timedemo <demo>      Plays the given demo as fast as possible and\n"
+               "                        prints frame time statistics on exit\n"
+               " --dynamicres <ms>      Lowers the resolution of the 3D view while\n"
+               "                        drawing it takes longer than <ms> milliseconds\n"
+               " --detail <level>       Casts every column (0), every second (1) or\n"
+               "                        every fourth (2) and widens them on screen\n"
+               " --offscreen            Renders without a window (for use with "
+               "--timedemo)\n"
+               " --blitbench            Compares the palette conversion kernels with\n"
+               "                        SDL_BlitSurface and exits\n"
+               " --copypresent          Converts the screen into a surface and copies\n"
+               "                        it to the texture instead of converting into\n"
+               "                        the locked texture\n"
+               " --uncapped             Draws frames between the 70 Hz game tics,\n"
+               "                        interpolating the view, actors and doors\n"
+               " --renderthreads <n>    Number of threads casting the walls\n"
+               "                        (default: 0 -> one per CPU, 1 disables)\n"
+               " --profilecsv <file>    Writes the time of each frame phase to <file>\n"
+               " --trace <file>         Writes frame phases, level loads and audio\n"
+               "                        callbacks to <file> as a Chrome/Perfetto trace\n"
+               " --noscalertables       Scale walls with the stepping loop instead of\n"
+               "                        precomputed tables (to compare with --timedemo)\n"
+               " --noheighttable        Divide for the height of every wall column\n"
+               "                        instead of looking it up (to compare with\n"
+               "                        --timedemo)\n"
+               " --nospritespans        Draw sprites by parsing their post commands\n"
+               "                        instead of the spans decoded at startup\n"
+               " --spritebench          Compares drawing many overlapping sprites from\n"
+               "                        decoded spans and from post commands and exits\n"
+               " --columnmajor          Draws the 3D view column by column into a\n"
+               "                        separate buffer and transposes it to the screen\n"
+               " --fusedfill            Fills floor and ceiling around each wall post\n"
+               "                        instead of clearing the whole 3D view first\n"
+               " --framereuse           Draws the walls again only when the view or a\n"
+               "                        door, pushwall or tile has changed\n"
+               " --raybench             Checks that the height table draws the same\n"
+               "                        frames as dividing for the heights, times both\n"
+               "                        and exits\n"
                " --windowed[-mouse]     Starts the game in a window [and grabs "
                "mouse]\n"
                "                        (use this when you have palette/fading "
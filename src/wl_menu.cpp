@@ -1811,7 +1811,7 @@ int MouseSensitivity(int)
     DrawMouseSens();
     do
     {
-        SDL_Delay(5);
+        TM_WaitNextTic();
         ReadAnyControl(&ci);
         switch (ci.dir)
         {
@@ -2071,7 +2071,7 @@ void EnterCtrlData(int index, CustomCtrls *cust, void (*DrawRtn)(int), void (*Pr
             redraw = 0;
         }
 
-        SDL_Delay(5);
+        TM_WaitNextTic();
         ReadAnyControl(&ci);
 
         if (type == MOUSE || type == JOYSTICK)
@@ -2118,7 +2118,7 @@ void EnterCtrlData(int index, CustomCtrls *cust, void (*DrawRtn)(int), void (*Pr
                     VW_UpdateScreen();
                 }
                 else
-                    SDL_Delay(5);
+                    TM_WaitNextTic();
 
                 //
                 // WHICH TYPE OF INPUT DO WE PROCESS?
@@ -2242,7 +2242,7 @@ void EnterCtrlData(int index, CustomCtrls *cust, void (*DrawRtn)(int), void (*Pr
             redraw = 1;
             SD_PlaySound(MOVEGUN1SND);
             while (ReadAnyControl(&ci), ci.dir != dir_None)
-                SDL_Delay(5);
+                TM_WaitNextTic();
             IN_ClearKeysDown();
             break;
 
@@ -2256,7 +2256,7 @@ void EnterCtrlData(int index, CustomCtrls *cust, void (*DrawRtn)(int), void (*Pr
             redraw = 1;
             SD_PlaySound(MOVEGUN1SND);
             while (ReadAnyControl(&ci), ci.dir != dir_None)
-                SDL_Delay(5);
+                TM_WaitNextTic();
             IN_ClearKeysDown();
             break;
         case dir_North:
@@ -2642,20 +2642,21 @@ void DrawCustKeys(int hilight)
 ////////////////////////////////////////////////////////////////////
 int CP_ChangeView(int)
 {
-    int exit = 0, oldview, newview;
+    int exit = 0, oldview, newview, olddetail, newdetail;
     ControlInfo ci;
 
     WindowX = WindowY = 0;
     WindowW = 320;
     WindowH = 200;
     newview = oldview = viewsize;
-    DrawChangeView(oldview);
+    newdetail = olddetail = detailshift;
+    DrawChangeView(oldview, olddetail);
     MenuFadeIn();
 
     do
     {
         CheckPause();
-        SDL_Delay(5);
+        TM_WaitNextTic();
         ReadAnyControl(&ci);
         switch (ci.dir)
         {
@@ -2665,9 +2666,12 @@ int CP_ChangeView(int)
             if (newview < 4)
                 newview = 4;
             if (newview >= 19)
-                DrawChangeView(newview);
+                DrawChangeView(newview, newdetail);
             else
+            {
                 ShowViewSize(newview);
+                DrawViewDetail(newdetail);
+            }
             VW_UpdateScreen();
             SD_PlaySound(HITWALLSND);
             TicDelay(10);
@@ -2679,16 +2683,28 @@ int CP_ChangeView(int)
             if (newview >= 21)
             {
                 newview = 21;
-                DrawChangeView(newview);
+                DrawChangeView(newview, newdetail);
             }
             else
+            {
                 ShowViewSize(newview);
+                DrawViewDetail(newdetail);
+            }
             VW_UpdateScreen();
             SD_PlaySound(HITWALLSND);
             TicDelay(10);
             break;
         }
 
+        if (Keyboard[sc_D])
+        {
+            IN_ClearKey(sc_D);
+            newdetail = (newdetail + 1) % (MAXDETAILSHIFT + 1);
+            DrawViewDetail(newdetail);
+            VW_UpdateScreen();
+            SD_PlaySound(HITWALLSND);
+        }
+
         if (ci.button0 || Keyboard[sc_Enter])
             exit = 1;
         else if (ci.button1 || Keyboard[sc_Escape])
@@ -2701,10 +2717,11 @@ int CP_ChangeView(int)
         }
     } while (!exit);
 
-    if (oldview != newview)
+    if (oldview != newview || olddetail != newdetail)
     {
         SD_PlaySound(SHOOTSND);
         Message(STR_THINK "...");
+        detailshift = newdetail;
         NewViewSize(newview);
     }
 
@@ -2720,7 +2737,7 @@ int CP_ChangeView(int)
 //
 // DRAW THE CHANGEVIEW SCREEN
 //
-void DrawChangeView(int view)
+void DrawChangeView(int view, int detail)
 {
     int rescaledHeight = screenHeight / scaleFactor;
     if (view != 21)
@@ -2742,9 +2759,31 @@ void DrawChangeView(int view)
     US_CPrint(STR_SIZE2 "\n");
     US_CPrint(STR_SIZE3);
 #endif
+    DrawViewDetail(detail);
     VW_UpdateScreen();
 }
 
+/////////////////////////////
+//
+// DRAW THE DETAIL LEVEL IN SMALL PRINT ABOVE THE VIEW
+//
+void DrawViewDetail(int detail)
+{
+    static const char *detailnames[MAXDETAILSHIFT + 1] = {STR_DETAILHIGH, STR_DETAILLOW, STR_DETAILLOWEST};
+    char detailstr[64];
+    int oldfont = fontnumber;
+
+    strcpy(detailstr, STR_DETAIL);
+    strcat(detailstr, detailnames[detail]);
+
+    fontnumber = 0;
+    VWB_Bar(0, 0, 320, 10, bordercol);
+    PrintY = 1;
+    SETFONTCOLOR(HIGHLIGHT, bordercol);
+    US_CPrint(detailstr);
+    fontnumber = oldfont;
+}
+
 ////////////////////////////////////////////////////////////////////
 //
 // QUIT THIS INFERNAL GAME!
@@ -3066,7 +3105,7 @@ int HandleMenu(CP_iteminfo *item_i, CP_itemtype *items, void (*routine)(int w))
             VW_UpdateScreen();
         }
         else
-            SDL_Delay(5);
+            TM_WaitNextTic();
 
         CheckPause();
 
@@ -3257,7 +3296,7 @@ void DrawHalfStep(int x, int y)
     VWB_DrawPic(x, y, C_CURSOR1PIC);
     VW_UpdateScreen();
     SD_PlaySound(MOVEGUN1SND);
-    SDL_Delay(8 * 100 / 7);
+    Delay(8);
 }
 
 //
@@ -3295,7 +3334,7 @@ void TicDelay(int count)
     int32_t startTime = GetTimeCount();
     do
     {
-        SDL_Delay(5);
+        TM_WaitNextTic();
         ReadAnyControl(&ci);
     } while ((int32_t)GetTimeCount() - startTime < count && ci.dir != dir_None);
 }
@@ -3494,7 +3533,7 @@ int Confirm(const char *string)
             lastBlinkTime = GetTimeCount();
         }
         else
-            SDL_Delay(5);
+            TM_WaitNextTic();
 
 #ifdef SPANISH
     } while (!Keyboard[sc_S] && !Keyboard[sc_N] && !Keyboard[sc_Escape]);
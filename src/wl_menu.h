@@ -161,7 +161,8 @@ void DrawSoundMenu(void);
 void DrawLoadSaveScreen(int loadsave);
 void DrawNewEpisode(void);
 void DrawNewGame(void);
-void DrawChangeView(int view);
+void DrawChangeView(int view, int detail);
+void DrawViewDetail(int detail);
 void DrawMouseSens(void);
 void DrawCtlScreen(void);
 void DrawCustomScreen(void);
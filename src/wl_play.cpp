@@ -37,6 +37,7 @@ int godmode, singlestep, extravbls = 0;
 
 byte tilemap[MAPSIZE][MAPSIZE]; // wall values only
 byte spotvis[MAPSIZE][MAPSIZE];
+uint32_t worldchanges;
 objtype *actorat[MAPSIZE][MAPSIZE];
 
 //
@@ -44,6 +45,35 @@ objtype *actorat[MAPSIZE][MAPSIZE];
 //
 unsigned tics;
 
+//
+// uncapped rendering: frames are drawn between the tics, interpolated from
+// the state of the previous tic to the current one
+//
+boolean uncapped;
+
+static fixed prevobjx[MAXACTORS], prevobjy[MAXACTORS];
+static boolean prevobjvalid[MAXACTORS];
+static short prevangle;
+static word prevdoorposition[MAXDOORS];
+static word prevpwallstate, prevpwallx, prevpwally;
+
+//
+// what an interpolated frame changes in an actor: its position, and what
+// DrawScaleds and TransformActor leave behind
+//
+typedef struct
+{
+    fixed x, y;
+    activetype active;
+    uint32_t flags;
+    short viewx;
+    word viewheight;
+    fixed transx, transy;
+} savedactor_t;
+
+static savedactor_t savedactors[MAXACTORS];
+static word saveddoorposition[MAXDOORS];
+
 //
 // control info
 //
@@ -420,15 +450,15 @@ void PollControls(void)
     //
     if (demoplayback || demorecord) // demo recording and playback needs to be constant
     {
-        // wait up to DEMOTICS Wolf tics
-        uint32_t curtime = SDL_GetTicks();
+        // wait up to DEMOTICS Wolf tics, or not at all when timing a demo
+        int32_t curtime = GetTimeCount();
         lasttimecount += DEMOTICS;
-        int32_t timediff = (lasttimecount * 100) / 7 - curtime;
-        if (timediff > 0)
-            SDL_Delay(timediff);
+        int32_t timediff = lasttimecount - curtime;
+        if (timediff > 0 && !timedemo)
+            TM_WaitForTic(lasttimecount);
 
-        if (timediff < -2 * DEMOTICS)            // more than 2-times DEMOTICS behind?
-            lasttimecount = (curtime * 7) / 100; // yes, set to current timecount
+        if (timediff < -2 * DEMOTICS) // more than 2-times DEMOTICS behind?
+            lasttimecount = curtime;  // yes, set to current timecount
 
         tics = DEMOTICS;
     }
@@ -964,6 +994,14 @@ void ContinueMusic(int offs)
 SDL_Color redshifts[NUMREDSHIFTS][256];
 SDL_Color whiteshifts[NUMWHITESHIFTS][256];
 
+//
+// the shifts and the normal palette mapped to screen colors, so a shift
+// only selects a table
+//
+uint32_t redshiftluts[NUMREDSHIFTS][256];
+uint32_t whiteshiftluts[NUMWHITESHIFTS][256];
+uint32_t gamepallut[256];
+
 int damagecount, bonuscount;
 boolean palshifted;
 
@@ -1018,6 +1056,12 @@ void InitRedShifts(void)
             workptr++;
         }
     }
+
+    for (i = 0; i < NUMREDSHIFTS; i++)
+        VL_MapPalette(redshifts[i], redshiftluts[i]);
+    for (i = 0; i < NUMWHITESHIFTS; i++)
+        VL_MapPalette(whiteshifts[i], whiteshiftluts[i]);
+    VL_MapPalette(gamepal, gamepallut);
 }
 
 /*
@@ -1099,17 +1143,17 @@ void UpdatePaletteShifts(void)
 
     if (red)
     {
-        VL_SetPalette(redshifts[red - 1], false);
+        VL_SetPaletteLut(redshifts[red - 1], redshiftluts[red - 1]);
         palshifted = true;
     }
     else if (white)
     {
-        VL_SetPalette(whiteshifts[white - 1], false);
+        VL_SetPaletteLut(whiteshifts[white - 1], whiteshiftluts[white - 1]);
         palshifted = true;
     }
     else if (palshifted)
     {
-        VL_SetPalette(gamepal, false); // back to normal
+        VL_SetPaletteLut(gamepal, gamepallut); // back to normal
         palshifted = false;
     }
 }
@@ -1246,6 +1290,167 @@ think:
 
 //==========================================================================
 
+/*
+===================
+=
+= SaveTicState
+=
+= Remembers what the interpolated frames start from before the next tic
+= is simulated
+=
+===================
+*/
+
+void SaveTicState(void)
+{
+    objtype *ob;
+    int i;
+
+    memset(prevobjvalid, 0, sizeof(prevobjvalid));
+    for (ob = player; ob; ob = ob->next)
+    {
+        i = (int)(ob - objlist);
+        prevobjx[i] = ob->x;
+        prevobjy[i] = ob->y;
+        prevobjvalid[i] = true;
+    }
+    prevangle = player->angle;
+
+    memcpy(prevdoorposition, doorposition, sizeof(doorposition));
+
+    prevpwallstate = pwallstate;
+    prevpwallx = pwallx;
+    prevpwally = pwally;
+}
+
+/*
+===================
+=
+= DrawInterpolatedFrame
+=
+= Draws the view at the time elapsed since the last tic, between the
+= previous and the current tic state.  Everything that is interpolated is
+= put back afterwards, so the game never sees it.
+=
+===================
+*/
+
+void DrawInterpolatedFrame(void)
+{
+    objtype *ob;
+    savedactor_t *saved;
+    int i, numdoors, delta;
+    fixed frac = TM_TicFraction(lasttimecount);
+
+    memcpy(saveddoorposition, doorposition, sizeof(doorposition));
+    word savedpwallpos = pwallpos;
+    short savedangle = player->angle;
+
+    //
+    // actors, skipping anything that was spawned or moved a tile at once
+    //
+    for (ob = player; ob; ob = ob->next)
+    {
+        i = (int)(ob - objlist);
+        saved = &savedactors[i];
+        saved->x = ob->x;
+        saved->y = ob->y;
+        saved->active = ob->active;
+        saved->flags = ob->flags;
+        saved->viewx = ob->viewx;
+        saved->viewheight = ob->viewheight;
+        saved->transx = ob->transx;
+        saved->transy = ob->transy;
+
+        if (!prevobjvalid[i] || labs(ob->x - prevobjx[i]) > TILEGLOBAL || labs(ob->y - prevobjy[i]) > TILEGLOBAL)
+            continue;
+
+        ob->x = prevobjx[i] + FixedMul(ob->x - prevobjx[i], frac);
+        ob->y = prevobjy[i] + FixedMul(ob->y - prevobjy[i], frac);
+    }
+
+    //
+    // view angle, the short way round
+    //
+    delta = player->angle - prevangle;
+    if (delta > ANGLES / 2)
+        delta -= ANGLES;
+    else if (delta < -ANGLES / 2)
+        delta += ANGLES;
+    player->angle = (short)(prevangle + FixedMul(delta, frac));
+    if (player->angle < 0)
+        player->angle += ANGLES;
+    else if (player->angle >= ANGLES)
+        player->angle -= ANGLES;
+
+    numdoors = (int)(lastdoorobj - doorobjlist);
+    for (i = 0; i < numdoors; i++)
+        doorposition[i] = (word)(prevdoorposition[i] + FixedMul(doorposition[i] - prevdoorposition[i], frac));
+
+    //
+    // the pushwall, as long as it is still in the same block
+    //
+    if (pwallstate && pwallstate > prevpwallstate && pwallx == prevpwallx && pwally == prevpwally)
+        pwallpos = ((prevpwallstate + FixedMul(pwallstate - prevpwallstate, frac)) / 2) & 63;
+
+    boolean wallsmoved = memcmp(doorposition, saveddoorposition, sizeof(doorposition)) || pwallpos != savedpwallpos;
+    if (wallsmoved)
+        MarkWorldChanged();
+
+    interpolating = true;
+    ThreeDRefresh();
+    interpolating = false;
+
+    for (ob = player; ob; ob = ob->next)
+    {
+        saved = &savedactors[ob - objlist];
+        ob->x = saved->x;
+        ob->y = saved->y;
+        ob->active = saved->active;
+        ob->flags = saved->flags;
+        ob->viewx = saved->viewx;
+        ob->viewheight = saved->viewheight;
+        ob->transx = saved->transx;
+        ob->transy = saved->transy;
+    }
+    player->angle = savedangle;
+    memcpy(doorposition, saveddoorposition, sizeof(doorposition));
+    pwallpos = savedpwallpos;
+    if (wallsmoved)
+        MarkWorldChanged();
+
+    CalcViewVariables(); // sound locations use the real view
+}
+
+/*
+===================
+=
+= DrawInterpolatedFrames
+=
+= Keeps drawing interpolated frames until the next tic is due
+=
+===================
+*/
+
+void DrawInterpolatedFrames(void)
+{
+    unsigned steptics = tics;
+
+    ProfileBegin(prof_walls);
+    UpdateVisibility();
+    ProfileEnd();
+
+    do
+    {
+        DrawInterpolatedFrame();
+        tics = 0; // the fps counter only counts the tics once
+    } while (!screenfaded && !playstate && (int32_t)GetTimeCount() <= lasttimecount);
+
+    tics = steptics;
+}
+
+//==========================================================================
+
 /*
 ===================
 =
@@ -1257,6 +1462,7 @@ int32_t funnyticount;
 
 void PlayLoop(void)
 {
+    boolean interpolate = uncapped && !demorecord && !demoplayback;
 
     playstate = ex_stillplaying;
     lasttimecount = GetTimeCount();
@@ -1272,20 +1478,48 @@ void PlayLoop(void)
 
     do
     {
+        //
+        // don't count fades against the frame times of a timedemo
+        //
+        boolean frametimed = timedemo && !screenfaded && !fizzlein;
+        Uint64 framestart = frametimed ? SDL_GetPerformanceCounter() : 0;
+
+        ProfileStartFrame();
+
         //
         // actor thinking
         //
         madenoise = false;
 
+        if (interpolate)
+            SaveTicState();
+
+        ProfileBegin(prof_think);
         MoveDoors();
         MovePWalls();
 
         for (obj = player; obj; obj = obj->next)
             DoActor(obj);
+        ProfileEnd();
 
-        UpdatePaletteShifts();
+        //
+        // fade in while the game runs, each refresh shows the next step.
+        // The flashes wait for the fade, which owns the palette until done
+        //
+        if (screenfaded)
+        {
+            if (!VL_FadeActive())
+                VL_StartFadeIn(0, 255, gamepal, 30);
+            VL_UpdateFade(false);
+        }
+
+        if (!VL_FadeActive())
+            UpdatePaletteShifts();
 
-        ThreeDRefresh();
+        if (interpolate)
+            DrawInterpolatedFrames();
+        else
+            ThreeDRefresh();
 
         //
         // MAKE FUNNY FACE IF BJ DOESN'T MOVE FOR AWHILE
@@ -1304,8 +1538,6 @@ void PlayLoop(void)
         gamestate.TimeCount += tics;
 
         UpdateSoundLoc(); // JAB
-        if (screenfaded)
-            VW_FadeIn();
 
         CheckKeys();
 
@@ -1331,7 +1563,16 @@ void PlayLoop(void)
 
         // Ensure that control is only given to the player once the screen has fully faded in.
         if (!screenfaded || !fizzlein)
+        {
+            ProfileBegin(prof_controls);
             PollControls();
+            ProfileEnd();
+        }
+
+        if (frametimed)
+            TimeDemoFrame(SDL_GetPerformanceCounter() - framestart);
+
+        ProfileEndFrame();
 
     } while (!playstate && !startgame);
 
@@ -0,0 +1,513 @@
+// WL_PROF.C
+
+#include "wl_def.h"
+#pragma hdrstop
+
+/*
+=============================================================================
+
+                                                 LOCAL CONSTANTS
+
+=============================================================================
+*/
+
+#define PROFFRAMES 64 // frames averaged by the overlay
+#define PROFDEPTH 4   // phases running inside each other
+
+#define PROFOTHER NUMPROFPHASES       // time of the frame outside all phases
+#define PROFTOTAL (NUMPROFPHASES + 1) // time of the whole frame
+#define PROFCOLUMNS (NUMPROFPHASES + 2)
+
+#define PROFWIDTH 124
+#define PROFBARX 80
+#define PROFBARWIDTH 40
+#define PROFBARMS 16.0 // frame time filling a whole bar
+
+/*
+=============================================================================
+
+                                                 GLOBAL VARIABLES
+
+=============================================================================
+*/
+
+boolean profoverlay;
+
+/*
+=============================================================================
+
+                                                 LOCAL VARIABLES
+
+=============================================================================
+*/
+
+static const char *profnames[PROFCOLUMNS] = {"clear", "walls", "sprites", "weapon", "blit",
+                                             "present", "think", "controls", "other", "total"};
+static const byte profcolors[PROFCOLUMNS] = {12, 10, 9, 14, 11, 13, 6, 2, 8, 15};
+
+static FILE *profcsv;
+static int32_t profframenum;
+
+static boolean profiling; // a frame is being measured
+static Uint64 profframestart, proflast;
+static Uint64 profticks[NUMPROFPHASES];
+static profphase_t profstack[PROFDEPTH];
+static int profdepth;
+
+static float profhistory[PROFFRAMES][PROFCOLUMNS]; // milliseconds
+static int profhead, profcount;
+
+//
+// trace events in the Chrome about:tracing / Perfetto JSON format. Every
+// thread records its events into a buffer of its own without waiting, the
+// main thread writes them out at the end of each frame and at shutdown
+//
+#define TRACETHREADS 8    // threads that can record events
+#define TRACEEVENTS 16384 // events a thread can record between two writes
+
+typedef struct
+{
+    const char *name; // NULL ends the innermost event of the thread
+    char phase;
+    Uint64 time;
+} traceevent_t;
+
+typedef struct
+{
+    unsigned long tid;
+    SDL_atomic_t head; // moved by the recording thread
+    SDL_atomic_t tail; // moved by TraceFlush
+    int dropped;       // events lost because the buffer was full
+    int open;          // recorded begins not ended yet, their ends always fit
+    int skipped;       // dropped begins not ended yet, their ends are dropped too
+    traceevent_t events[TRACEEVENTS];
+} tracebuffer_t;
+
+static FILE *tracefile;
+static volatile boolean tracing;
+static tracebuffer_t *tracebuffers;
+static SDL_atomic_t numtracebuffers; // claimed by the threads, may exceed TRACETHREADS
+static unsigned long tracemainthread;
+static thread_local tracebuffer_t *threadtrace;
+static thread_local boolean threadnottraced; // came after TRACETHREADS others
+
+static void TraceFlush(void);
+
+/*
+===================
+=
+= ProfileOpenCSV
+=
+= Writes the phase times of every frame to the given file
+=
+===================
+*/
+
+void ProfileOpenCSV(const char *filename)
+{
+    int i;
+
+    profcsv = fopen(filename, "w");
+    if (!profcsv)
+        Quit("Unable to write the profile %s!", filename);
+
+    fprintf(profcsv, "frame");
+    for (i = 0; i < PROFCOLUMNS; i++)
+        fprintf(profcsv, ",%s", profnames[i]);
+    fprintf(profcsv, "\n");
+}
+
+/*
+===================
+=
+= ProfileShutdown
+=
+===================
+*/
+
+void ProfileShutdown(void)
+{
+    if (profcsv)
+    {
+        fclose(profcsv);
+        profcsv = NULL;
+    }
+}
+
+/*
+===================
+=
+= ProfileStartFrame
+=
+===================
+*/
+
+void ProfileStartFrame(void)
+{
+    if (tracing)
+        TraceBegin("frame");
+
+    profiling = profoverlay || profcsv != NULL;
+    if (!profiling)
+        return;
+
+    memset(profticks, 0, sizeof(profticks));
+    profdepth = 0;
+    profframestart = proflast = TM_Now();
+}
+
+/*
+===================
+=
+= ProfileEndFrame
+=
+= Stores the phase times of the frame for the overlay and the CSV file
+=
+===================
+*/
+
+void ProfileEndFrame(void)
+{
+    int i;
+    float *times;
+    double phases;
+
+    if (tracing)
+    {
+        TraceEnd();
+        TraceFlush();
+    }
+
+    if (!profiling)
+        return;
+    profiling = false;
+
+    times = profhistory[profhead];
+    profhead = (profhead + 1) % PROFFRAMES;
+    if (profcount < PROFFRAMES)
+        profcount++;
+
+    phases = 0;
+    for (i = 0; i < NUMPROFPHASES; i++)
+    {
+        times[i] = (float)(profticks[i] * 1000.0 / tmfreq);
+        phases += times[i];
+    }
+    times[PROFTOTAL] = (float)((TM_Now() - profframestart) * 1000.0 / tmfreq);
+    times[PROFOTHER] = times[PROFTOTAL] > phases ? (float)(times[PROFTOTAL] - phases) : 0;
+
+    if (profcsv)
+    {
+        fprintf(profcsv, "%d", profframenum);
+        for (i = 0; i < PROFCOLUMNS; i++)
+            fprintf(profcsv, ",%.3f", times[i]);
+        fprintf(profcsv, "\n");
+    }
+    profframenum++;
+}
+
+/*
+===================
+=
+= ProfileBegin
+=
+= Time up to the next ProfileBegin or ProfileEnd is charged to the phase,
+= a phase started inside another one pauses the outer phase
+=
+===================
+*/
+
+void ProfileBegin(profphase_t phase)
+{
+    if (tracing)
+        TraceBegin(profnames[phase]);
+
+    if (!profiling)
+        return;
+
+    Uint64 now = TM_Now();
+
+    if (profdepth)
+        profticks[profstack[profdepth - 1]] += now - proflast;
+    if (profdepth < PROFDEPTH)
+        profstack[profdepth++] = phase;
+    proflast = now;
+}
+
+/*
+===================
+=
+= ProfileEnd
+=
+===================
+*/
+
+void ProfileEnd(void)
+{
+    if (tracing)
+        TraceEnd();
+
+    if (!profiling || !profdepth)
+        return;
+
+    Uint64 now = TM_Now();
+
+    profticks[profstack[--profdepth]] += now - proflast;
+    proflast = now;
+}
+
+/*
+===================
+=
+= DrawProfileOverlay
+=
+= Average time of each phase over the last frames, drawn in the upper
+= right corner of the screen
+=
+===================
+*/
+
+void DrawProfileOverlay(void)
+{
+    int i, f, x, y, width;
+    double average;
+    char str[16];
+
+    x = 320 - PROFWIDTH;
+    VWB_Bar(x, 0, PROFWIDTH, PROFCOLUMNS * 10 + 1, bordercol);
+
+    if (!profcount)
+        return;
+
+    fontnumber = 0;
+    SETFONTCOLOR(7, 127);
+
+    for (i = 0; i < PROFCOLUMNS; i++)
+    {
+        average = 0;
+        for (f = 0; f < profcount; f++)
+            average += profhistory[f][i];
+        average /= profcount;
+
+        y = i * 10 + 1;
+        PrintX = x + 2;
+        PrintY = y;
+        US_Print(profnames[i]);
+
+        snprintf(str, sizeof(str), "%.2f", average);
+        PrintX = x + PROFBARX - 30;
+        PrintY = y;
+        US_Print(str);
+
+        width = (int)(average * PROFBARWIDTH / PROFBARMS);
+        if (width > PROFBARWIDTH)
+            width = PROFBARWIDTH;
+        if (width > 0)
+            VWB_Bar(x + PROFBARX, y + 2, width, 6, profcolors[i]);
+    }
+}
+
+/*
+===================
+=
+= TraceOpen
+=
+===================
+*/
+
+void TraceOpen(const char *filename)
+{
+    tracefile = fopen(filename, "w");
+    if (!tracefile)
+        Quit("Unable to write the trace %s!", filename);
+
+    tracebuffers = (tracebuffer_t *)calloc(TRACETHREADS, sizeof(tracebuffer_t));
+    CHECKMALLOCRESULT(tracebuffers);
+    tracemainthread = (unsigned long)SDL_ThreadID();
+
+    fprintf(tracefile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(tracefile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"main\"}}",
+            tracemainthread);
+    tracing = true;
+}
+
+/*
+===================
+=
+= TraceFlush
+=
+= Writes out the events the threads have recorded. Only called from the
+= main thread
+=
+===================
+*/
+
+static void TraceFlush(void)
+{
+    int i, numbuffers, head, tail;
+    tracebuffer_t *buffer;
+    traceevent_t *event;
+
+    numbuffers = SDL_AtomicGet(&numtracebuffers);
+    if (numbuffers > TRACETHREADS)
+        numbuffers = TRACETHREADS;
+
+    for (i = 0; i < numbuffers; i++)
+    {
+        buffer = &tracebuffers[i];
+        head = SDL_AtomicGet(&buffer->head);
+        SDL_MemoryBarrierAcquire();
+
+        for (tail = SDL_AtomicGet(&buffer->tail); tail != head; tail++)
+        {
+            event = &buffer->events[tail % TRACEEVENTS];
+            double ts = event->time * 1000000.0 / tmfreq;
+
+            if (event->name)
+                fprintf(tracefile, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%lu}", event->name,
+                        event->phase, ts, buffer->tid);
+            else
+                fprintf(tracefile, ",\n{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%lu}", event->phase, ts,
+                        buffer->tid);
+        }
+
+        SDL_MemoryBarrierRelease();
+        SDL_AtomicSet(&buffer->tail, tail);
+    }
+}
+
+/*
+===================
+=
+= TraceShutdown
+=
+===================
+*/
+
+void TraceShutdown(void)
+{
+    int i, numbuffers, dropped;
+
+    if (!tracing)
+        return;
+
+    tracing = false;
+    TraceFlush();
+    fprintf(tracefile, "\n]}\n");
+    fclose(tracefile);
+    tracefile = NULL;
+
+    numbuffers = SDL_AtomicGet(&numtracebuffers);
+    dropped = 0;
+    for (i = 0; i < numbuffers && i < TRACETHREADS; i++)
+        dropped += tracebuffers[i].dropped;
+    if (dropped)
+        LOG_Warnf("trace: %d events dropped, the buffers filled up between two frames", dropped);
+    if (numbuffers > TRACETHREADS)
+        LOG_Warnf("trace: only the first %d of %d threads were traced", TRACETHREADS, numbuffers);
+
+    // a thread may still be recording, the buffers are left to the exit
+}
+
+/*
+===================
+=
+= TraceEvent
+=
+= Records an event in the buffer of the calling thread. Never waits, a
+= begin that does not fit is dropped together with its end and everything
+= between, so the events stay nested
+=
+===================
+*/
+
+static void TraceEvent(const char *name, char phase)
+{
+    tracebuffer_t *buffer = threadtrace;
+    traceevent_t *event;
+    int head, slot;
+
+    if (!buffer)
+    {
+        if (threadnottraced)
+            return;
+        slot = SDL_AtomicAdd(&numtracebuffers, 1);
+        if (slot >= TRACETHREADS)
+        {
+            threadnottraced = true;
+            return;
+        }
+        buffer = threadtrace = &tracebuffers[slot];
+        buffer->tid = (unsigned long)SDL_ThreadID();
+    }
+
+    if (buffer->skipped)
+    {
+        buffer->skipped += phase == 'B' ? 1 : -1;
+        buffer->dropped++;
+        return;
+    }
+
+    head = SDL_AtomicGet(&buffer->head);
+    if (phase == 'B')
+    {
+        //
+        // room for the begin, its end and the ends of the open events
+        //
+        if (head - SDL_AtomicGet(&buffer->tail) + buffer->open + 2 > TRACEEVENTS)
+        {
+            buffer->skipped = 1;
+            buffer->dropped++;
+            return;
+        }
+        buffer->open++;
+    }
+    else if (buffer->open)
+        buffer->open--;
+
+    event = &buffer->events[head % TRACEEVENTS];
+    event->name = name;
+    event->phase = phase;
+    event->time = TM_Now();
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&buffer->head, head + 1);
+
+    //
+    // the main thread writes out early rather than dropping, outside of
+    // the frames (menus, loading)
+    //
+    if (buffer->tid == tracemainthread && head + 1 - SDL_AtomicGet(&buffer->tail) > TRACEEVENTS / 2)
+        TraceFlush();
+}
+
+/*
+===================
+=
+= TraceBegin
+=
+= Starts a duration event on the calling thread, ended by the next
+= TraceEnd on the same thread
+=
+===================
+*/
+
+void TraceBegin(const char *name)
+{
+    if (tracing)
+        TraceEvent(name, 'B');
+}
+
+/*
+===================
+=
+= TraceEnd
+=
+===================
+*/
+
+void TraceEnd(void)
+{
+    if (tracing)
+        TraceEvent(NULL, 'E');
+}
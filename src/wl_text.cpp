@@ -640,7 +640,7 @@ void ShowArticle(char *article)
                 firstpage = false;
             }
         }
-        SDL_Delay(5);
+        TM_WaitNextTic();
 
         LastScan = 0;
         ReadAnyControl(&ci);